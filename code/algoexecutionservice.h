@@ -1,12 +1,12 @@
 #ifndef ALGOEXECUTIONSERVICEHPP
-#define ALGOEXECUTIONSERVICEHPP
-
-#include "soa.hpp"
-#include "executionservice.hpp"
-#include <unordered_map>
-#include "tools.h"
-
-
+#define ALGOEXECUTIONSERVICEHPP
+
+#include "soa.hpp"
+#include "executionservice.hpp"
+#include "tools.h"
+#include "metrics.h"
+
+
 /**
 * An algo execution that process algo execution.
 * Type T is the product type.
@@ -20,16 +20,16 @@ private:
 public:
 
 	AlgoExecution() = default;
-	AlgoExecution(const T& product, PricingSide side, string orderId, OrderType orderType, double price, long visibleQuantity, long hiddenQuantity, string parentOrderId, bool isChildOrder);
+	AlgoExecution(const T& product, PricingSide side, string orderId, OrderType orderType, TickPrice price, long visibleQuantity, long hiddenQuantity, string parentOrderId, bool isChildOrder);
 
 	ExecutionOrder<T>* GetExecutionOrder() const;
 
 
-};
-
+};
+
 template<typename T>
-class AlgoExecutionService;
-
+class AlgoExecutionService;
+
 template<typename T>
 class AEListener : public ServiceListener<OrderBook<T>>
 {
@@ -51,9 +51,9 @@ public:
 	// Listener callback to process an update event to the Service
 	void ProcessUpdate(OrderBook<T>& data);
 
-};
-
-
+};
+
+
 /**
 * AlgoExecutionService
 * Keyed on product identifier.
@@ -65,18 +65,21 @@ class AlgoExecutionService : public Service<string, AlgoExecution<T>>
 
 private:
 
-	unordered_map<string, AlgoExecution<T>> algoExecutions;
+	ProductTable<AlgoExecution<T>> algoExecutions;
 	vector<ServiceListener<AlgoExecution<T>>*> listeners;
 	AEListener<T>* listener;
-	double aggresing_spread;
-	bool isBid;
+	TickPrice aggresing_spread;
+	// orders sent so far, they alternate between bid and offer
+	atomic<long> ownAggressions;
+	atomic<long>* aggressions;
+	ServiceMetrics metrics;
 
 public:
 
 	AlgoExecutionService();
 
 	// Get data on our service given a key
-	AlgoExecution<T>& GetData(string key);
+	AlgoExecution<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(AlgoExecution<T>& data);
@@ -91,14 +94,18 @@ public:
 	AEListener<T>* GetListener();
 
 	void AlgoExecuteOrder(OrderBook<T>& _orderBook);
-};
-
-
-
-
-/*     implementation      */
-template<typename T>
-AlgoExecution<T>::AlgoExecution(const T& product, PricingSide side, string orderId, OrderType orderType, double price, long visibleQuantity, long hiddenQuantity, string parentOrderId, bool isChildOrder)
+
+	// Alternate sides with other services (e.g. the shards of ShardedMarketDataService)
+	// through a shared counter of orders
+	void ShareAggressions(atomic<long>* counter);
+};
+
+
+
+
+/*     implementation      */
+template<typename T>
+AlgoExecution<T>::AlgoExecution(const T& product, PricingSide side, string orderId, OrderType orderType, TickPrice price, long visibleQuantity, long hiddenQuantity, string parentOrderId, bool isChildOrder)
 	:executionOrder(new ExecutionOrder<T>(product, side, orderId, orderType, price, visibleQuantity, hiddenQuantity, parentOrderId, isChildOrder)) {}
 
 template<typename T>
@@ -106,8 +113,8 @@ ExecutionOrder<T>* AlgoExecution<T>::GetExecutionOrder() const
 {
 	return executionOrder;
 }
-
-
+
+
 template<typename T>
 AEListener<T>::AEListener(AlgoExecutionService<T>* service)
 	:AES(service) {}
@@ -122,24 +129,28 @@ void AEListener<T>::ProcessAdd(OrderBook<T>& _data)
 template<typename T>
 void AEListener<T>::ProcessRemove(OrderBook<T>& _data) {}
 
+// A book updated in place by a level event is looked at again like a new one
 template<typename T>
-void AEListener<T>::ProcessUpdate(OrderBook<T>& _data) {}
-
-
-
+void AEListener<T>::ProcessUpdate(OrderBook<T>& _data)
+{
+	AES->AlgoExecuteOrder(_data);
+}
+
+
+
 template<typename T>
 AlgoExecutionService<T>::AlgoExecutionService()
-	:listener(new AEListener<T>(this))
+	:listener(new AEListener<T>(this)), ownAggressions(0), aggressions(&ownAggressions), metrics("AlgoExecutionService")
 {
-	aggresing_spread = 1.0/128;
-	isBid = true;
+	// 1/128 of a point
+	aggresing_spread = TICKS_PER_POINT / 128;
 }
 
 
 template<typename T>
-AlgoExecution<T>& AlgoExecutionService<T>::GetData(string key)
+AlgoExecution<T>& AlgoExecutionService<T>::GetData(const string& key)
 {
-	return algoExecutions[key];
+	return algoExecutions[GetProductIndex(key)];
 }
 
 template<typename T>
@@ -163,38 +174,45 @@ AEListener<T>* AlgoExecutionService<T>::GetListener()
 {
 	return listener;
 }
-
+
 template<typename T>
 void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& data)
 {
-	T product = data.GetProduct();
-	string ticker = product.GetTicker();
+	const T& product = data.GetProduct();
+	metrics.In();
 
-	BidOffer bidOffer = data.GetBestBidOffer();
-	Order bidOrder = bidOffer.GetBidOrder();
-	Order offerOrder = bidOffer.GetOfferOrder();
+	const BidOffer& bidOffer = data.GetBestBidOffer();
+	const Order& bidOrder = bidOffer.GetBidOrder();
+	const Order& offerOrder = bidOffer.GetOfferOrder();
 
 	if (offerOrder.GetPrice() - bidOrder.GetPrice() == aggresing_spread)
 	{
 
-		PricingSide side = OFFER; long Q = offerOrder.GetQuantity(); double p = offerOrder.GetPrice();
-		if (isBid) {
+		PricingSide side = OFFER; long Q = offerOrder.GetQuantity(); TickPrice p = offerOrder.GetPrice();
+		if (aggressions->fetch_add(1, memory_order_relaxed) % 2 == 0) {
 			side = BID;
 			Q = bidOrder.GetQuantity();
 			p = bidOrder.GetPrice();
 		}
-		isBid = !isBid;
 
 		AlgoExecution<T> algoExecution(product, side, genID(), MARKET,
 			p, Q, 0, "", false);
 
-		algoExecutions[ticker] = algoExecution;
+		algoExecutions[product.GetIndex()] = algoExecution;
+		metrics.SetSize(algoExecutions.Size());
 
+		ListenerTimer timer(metrics, listeners.size());
 		for (auto l : listeners)
 		{
 			l->ProcessAdd(algoExecution);
 		}
 	}
-}
-
-#endif
+}
+
+template<typename T>
+void AlgoExecutionService<T>::ShareAggressions(atomic<long>* counter)
+{
+	aggressions = counter;
+}
+
+#endif
@@ -1,35 +1,35 @@
 #ifndef ALGOSTREAMINGSERVICEHPP
-#define ALGOSTREAMINGSERVICEHPP
-
-#include "soa.hpp"
-#include "streamingservice.hpp"
-#include "pricingservice.hpp"
-#include <string>
-#include <unordered_map>
-
+#define ALGOSTREAMINGSERVICEHPP
+
+#include "soa.hpp"
+#include "streamingservice.hpp"
+#include "pricingservice.hpp"
+#include "metrics.h"
+#include <string>
+
 /**
 * AlgoStreaming
 * Type T is the product type.
-*/
-template<typename T>
-class AlgoStream {
-private:
-	PriceStream<T>* priceStream;
-public:
-	AlgoStream() = default;
-	AlgoStream(PriceStream<T>* ps);
-	PriceStream<T>* GetPriceStream();
-};
-
-
-
+*/
+template<typename T>
+class AlgoStream {
+private:
+	PriceStream<T>* priceStream;
+public:
+	AlgoStream() = default;
+	AlgoStream(PriceStream<T>* ps);
+	PriceStream<T>* GetPriceStream();
+};
+
+
+
 template<typename T>
 class AlgoStreamingService;
 
 /**
 * AlgoStreamingListener
 * Type T is the product type.
-*/
+*/
 template<typename T>
 class AlgoStreamingListener : public ServiceListener<Price<T>>
 {
@@ -51,6 +51,9 @@ public:
 	// Listener callback to process an update event to the Service
 	void ProcessUpdate(Price<T>& data);
 
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(Price<T>* data, size_t n);
+
 };
 
 /**
@@ -62,18 +65,25 @@ class AlgoStreamingService : public Service<string, AlgoStream<T>>
 {
 
 private:
-	unordered_map<string, AlgoStream<T>> algoStreams;
+	ProductTable<AlgoStream<T>> algoStreams;
 	vector<ServiceListener<AlgoStream<T>>*> listeners;
 	ServiceListener<Price<T>>* algostrlistener;
 	// whether the visible size is 1 million
 	bool VisibleS1M;
+	// algo streams of the batch being published
+	vector<AlgoStream<T>> batch;
+	LatencyHistogram* hop;
+	ServiceMetrics metrics;
 
 public:
 
 	AlgoStreamingService();
 
+	// Build the two-way stream for a price
+	AlgoStream<T> MakeAlgoStream(Price<T>& price);
+
 	// Get data on our service given a key
-	AlgoStream<T>& GetData(string key);
+	AlgoStream<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(AlgoStream<T>& data);
@@ -90,7 +100,10 @@ public:
 	// Publish prices
 	void PublishPrice(Price<T>& price);
 
-};
+	// Publish a batch of prices as one batch of algo streams
+	void PublishPriceBatch(Price<T>* prices, size_t n);
+
+};
 
 
 
@@ -104,7 +117,7 @@ template<typename T>
 PriceStream<T>* AlgoStream<T>::GetPriceStream() {
 	return priceStream;
 }
-
+
 template<typename T>
 AlgoStreamingListener<T>::AlgoStreamingListener(AlgoStreamingService<T>* _service)
 :AS(_service) {}
@@ -115,25 +128,33 @@ void AlgoStreamingListener<T>::ProcessAdd(Price<T>& data)
 	AS->PublishPrice(data);
 }
 
+template<typename T>
+void AlgoStreamingListener<T>::ProcessAddBatch(Price<T>* data, size_t n)
+{
+	AS->PublishPriceBatch(data, n);
+}
+
 template<typename T>
 void AlgoStreamingListener<T>::ProcessRemove(Price<T>& data) {}
 
 template<typename T>
-void AlgoStreamingListener<T>::ProcessUpdate(Price<T>& data) {}
-
-
-template<typename T>
-AlgoStreamingService<T>::AlgoStreamingService()
-:algostrlistener(new AlgoStreamingListener<T>(this)), VisibleS1M(true) {}
+void AlgoStreamingListener<T>::ProcessUpdate(Price<T>& data) {}
+
+
+template<typename T>
+AlgoStreamingService<T>::AlgoStreamingService()
+:algostrlistener(new AlgoStreamingListener<T>(this)), VisibleS1M(true), hop(&LatencyTrace::Hop("AlgoStreamingService")), metrics("AlgoStreamingService") {}
 
-template<typename T>
-AlgoStream<T>& AlgoStreamingService<T>::GetData(string key) {
-	return algoStreams[key];
+template<typename T>
+AlgoStream<T>& AlgoStreamingService<T>::GetData(const string& key) {
+	return algoStreams[GetProductIndex(key)];
 }
 
-template<typename T>
+template<typename T>
 void  AlgoStreamingService<T>::OnMessage(AlgoStream<T>& data) {
-	algoStreams[data.GetPriceStream()->GetProduct().GetTicker()] = data;
+	algoStreams[data.GetPriceStream()->GetProduct().GetIndex()] = data;
+	metrics.In();
+	metrics.SetSize(algoStreams.Size());
 }
 
 template<typename T>
@@ -142,33 +163,58 @@ void AlgoStreamingService<T>::AddListener(ServiceListener<AlgoStream<T>> *listen
 }
 
 template<typename T>
-const vector<ServiceListener<AlgoStream<T>>*>& AlgoStreamingService<T>::GetListeners() const {
-	return listeners;
-}
-
-template<typename T>
-ServiceListener<Price<T>>* AlgoStreamingService<T>::GetListener() {
-	return algostrlistener;
-}
-
-template<typename T>
-void AlgoStreamingService<T>::PublishPrice(Price<T>& price) {
-	double mid = price.GetMid();
-	double Spread = price.GetBidOfferSpread();
-	double bid = mid - Spread / 2.0;
-	double offer = mid + Spread / 2.0;
+const vector<ServiceListener<AlgoStream<T>>*>& AlgoStreamingService<T>::GetListeners() const {
+	return listeners;
+}
+
+template<typename T>
+ServiceListener<Price<T>>* AlgoStreamingService<T>::GetListener() {
+	return algostrlistener;
+}
+
+template<typename T>
+AlgoStream<T> AlgoStreamingService<T>::MakeAlgoStream(Price<T>& price) {
+	// mid is rounded down to a tick, so this gives back the exact bid and offer
+	TickPrice mid = price.GetMid();
+	TickPrice Spread = price.GetBidOfferSpread();
+	TickPrice bid = mid - Spread / 2;
+	TickPrice offer = bid + Spread;
 	long visibleQuantity = (VisibleS1M + 1) * 10000000;
 	long hiddenQuantity = visibleQuantity * 2;
 	VisibleS1M = !VisibleS1M;
 
 	PriceStreamOrder _bidOrder(bid, visibleQuantity, hiddenQuantity, BID);
 	PriceStreamOrder _offerOrder(offer, visibleQuantity, hiddenQuantity, OFFER);
-	AlgoStream<T> _algoStream(new PriceStream<T>(price.GetProduct(), _bidOrder, _offerOrder));
+	PriceStream<T>* priceStream = new PriceStream<T>(price.GetProduct(), _bidOrder, _offerOrder);
+	priceStream->SetIngestTicks(price.GetIngestTicks());
+	hop->RecordSince(price.GetIngestTicks());
+	return AlgoStream<T>(priceStream);
+}
+
+template<typename T>
+void AlgoStreamingService<T>::PublishPrice(Price<T>& price) {
+	AlgoStream<T> _algoStream = MakeAlgoStream(price);
 	OnMessage(_algoStream);
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(_algoStream);
-	}
-
-}
-#endif
+	}
+
+}
+
+template<typename T>
+void AlgoStreamingService<T>::PublishPriceBatch(Price<T>* prices, size_t n) {
+	batch.clear();
+	for (size_t i = 0; i < n; i++)
+	{
+		batch.push_back(MakeAlgoStream(prices[i]));
+		OnMessage(batch.back());
+	}
+	ListenerTimer timer(metrics, n * listeners.size());
+	for (auto l : listeners)
+	{
+		l->ProcessAddBatch(batch.data(), batch.size());
+	}
+}
+#endif
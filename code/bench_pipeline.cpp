@@ -0,0 +1,352 @@
+// End to end benchmark of the four flows of main.cpp.
+// Builds the same services and listeners, runs one flow or all of them on the
+// input files of the current directory, and reports messages/sec, wall time
+// and the time spent in each stage. Results are also written as JSON.
+//
+// g++ -std=c++11 -O2 -pthread bench_pipeline.cpp -o bench_pipeline
+// ./bench_pipeline [all|prices|trades|marketdata|inquiries] [mapped|stream] [bench.json]
+//
+// Every listener is wrapped in a TimedListener. A stage's exclusive time is its
+// own time without the stages it called, so the exclusive times of a flow add
+// up to its wall time. The connector stage covers file reading, parsing and the
+// service's own OnMessage work. Timing adds two clock reads per callback.
+
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <chrono>
+
+#include "products.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.h"
+#include "streamingservice.hpp"
+#include "historicaldataservice.hpp"
+#include "guiservice.h"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.h"
+#include "executionservice.hpp"
+#include "inquiryservice.hpp"
+
+using namespace std;
+
+/**
+* Time and call counters of one stage of a flow.
+*/
+struct StageTimes
+{
+	string name;
+	long calls = 0;
+	long messages = 0;
+	double inclusive = 0;
+	double exclusive = 0;
+};
+
+/**
+* Stack of the stages currently running, used to split inclusive time into
+* exclusive time. Listeners are all called from the thread running the flow.
+*/
+class StageClock
+{
+
+public:
+
+	static void Enter();
+	static void Leave(StageTimes& stage, long messages);
+
+private:
+	struct Frame
+	{
+		chrono::steady_clock::time_point start;
+		double children;
+	};
+
+	static vector<Frame>& Stack();
+
+};
+
+/**
+* Listener forwarding every callback to another listener and timing it.
+*/
+template<typename V>
+class TimedListener : public ServiceListener<V>
+{
+
+public:
+
+	TimedListener(ServiceListener<V>* _listener, StageTimes* _stage);
+
+	void ProcessAdd(V& data);
+	void ProcessRemove(V& data);
+	void ProcessUpdate(V& data);
+	void ProcessAddBatch(V* data, size_t n);
+
+private:
+	ServiceListener<V>* listener;
+	StageTimes* stage;
+
+};
+
+/**
+* Results of one flow.
+*/
+struct FlowResult
+{
+	string name;
+	long messages = 0;
+	double seconds = 0;
+	vector<StageTimes*> stages;
+};
+
+
+
+
+/*    implementation     */
+void StageClock::Enter()
+{
+	Frame frame;
+	frame.start = chrono::steady_clock::now();
+	frame.children = 0;
+	Stack().push_back(frame);
+}
+
+void StageClock::Leave(StageTimes& stage, long messages)
+{
+	Frame frame = Stack().back();
+	Stack().pop_back();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - frame.start).count();
+	stage.calls++;
+	stage.messages += messages;
+	stage.inclusive += seconds;
+	stage.exclusive += seconds - frame.children;
+	if (!Stack().empty()) Stack().back().children += seconds;
+}
+
+vector<StageClock::Frame>& StageClock::Stack()
+{
+	static vector<Frame> stack;
+	return stack;
+}
+
+
+template<typename V>
+TimedListener<V>::TimedListener(ServiceListener<V>* _listener, StageTimes* _stage)
+	:listener(_listener), stage(_stage) {}
+
+template<typename V>
+void TimedListener<V>::ProcessAdd(V& data)
+{
+	StageClock::Enter();
+	listener->ProcessAdd(data);
+	StageClock::Leave(*stage, 1);
+}
+
+template<typename V>
+void TimedListener<V>::ProcessRemove(V& data)
+{
+	StageClock::Enter();
+	listener->ProcessRemove(data);
+	StageClock::Leave(*stage, 1);
+}
+
+template<typename V>
+void TimedListener<V>::ProcessUpdate(V& data)
+{
+	StageClock::Enter();
+	listener->ProcessUpdate(data);
+	StageClock::Leave(*stage, 1);
+}
+
+template<typename V>
+void TimedListener<V>::ProcessAddBatch(V* data, size_t n)
+{
+	StageClock::Enter();
+	listener->ProcessAddBatch(data, n);
+	StageClock::Leave(*stage, n);
+}
+
+
+deque<StageTimes> allStages;
+
+StageTimes* NewStage(FlowResult& flow, const string& name)
+{
+	allStages.push_back(StageTimes());
+	allStages.back().name = name;
+	flow.stages.push_back(&allStages.back());
+	return &allStages.back();
+}
+
+template<typename V>
+ServiceListener<V>* Timed(FlowResult& flow, const string& name, ServiceListener<V>* listener)
+{
+	return new TimedListener<V>(listener, NewStage(flow, name));
+}
+
+// Time a connector call as the root stage of a flow
+template<typename F>
+void RunFlow(FlowResult& flow, const string& connector, F consume)
+{
+	StageTimes* stage = NewStage(flow, connector);
+	auto start = chrono::steady_clock::now();
+	StageClock::Enter();
+	flow.messages = consume();
+	StageClock::Leave(*stage, flow.messages);
+	flow.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double PerSecond(long messages, double seconds)
+{
+	return seconds > 0 ? messages / seconds : 0;
+}
+
+void Print(const FlowResult& flow)
+{
+	cout << flow.name << ": " << flow.messages << " messages in " << flow.seconds << " s, "
+		<< (long)PerSecond(flow.messages, flow.seconds) << " messages/sec" << endl;
+	for (auto stage : flow.stages)
+	{
+		double share = flow.seconds > 0 ? 100 * stage->exclusive / flow.seconds : 0;
+		cout << "    " << stage->name << ": " << stage->exclusive << " s (" << share << "%), "
+			<< stage->calls << " calls, " << stage->messages << " messages" << endl;
+	}
+}
+
+void WriteJSON(const string& file_name, const string& mode, const vector<FlowResult>& flows)
+{
+	ofstream file(file_name);
+	long messages = 0;
+	double seconds = 0;
+	file << "{\n  \"mode\": \"" << mode << "\",\n  \"flows\": [";
+	for (size_t i = 0; i < flows.size(); i++)
+	{
+		const FlowResult& flow = flows[i];
+		messages += flow.messages;
+		seconds += flow.seconds;
+		file << (i ? "," : "") << "\n    {\"name\": \"" << flow.name << "\", \"messages\": " << flow.messages
+			<< ", \"seconds\": " << flow.seconds << ", \"messages_per_sec\": " << PerSecond(flow.messages, flow.seconds)
+			<< ", \"stages\": [";
+		for (size_t j = 0; j < flow.stages.size(); j++)
+		{
+			const StageTimes* stage = flow.stages[j];
+			file << (j ? "," : "") << "\n      {\"name\": \"" << stage->name << "\", \"calls\": " << stage->calls
+				<< ", \"messages\": " << stage->messages << ", \"exclusive_seconds\": " << stage->exclusive
+				<< ", \"inclusive_seconds\": " << stage->inclusive << "}";
+		}
+		file << "]}";
+	}
+	file << "\n  ],\n  \"total\": {\"messages\": " << messages << ", \"seconds\": " << seconds
+		<< ", \"messages_per_sec\": " << PerSecond(messages, seconds) << "}\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	string which = argc > 1 ? argv[1] : "all";
+	string mode = argc > 2 ? argv[2] : "mapped";
+	string json = argc > 3 ? argv[3] : "bench.json";
+	ReadMode readMode = mode == "stream" ? STREAM_READ : MAPPED_READ;
+	vector<FlowResult> flows;
+
+	// services and listeners wired as in main.cpp, executions also book trades
+	PricingService<Bond> PS;
+	AlgoStreamingService<Bond> ASS;
+	StreamingService<Bond> SS;
+	HistoricalDataService<PriceStream<Bond>> HDSPS("streaming.txt");
+	GUIService<Bond> GUIS(300);
+
+	TradeBookingService<Bond> TBS;
+	PositionService<Bond> POSS;
+	HistoricalDataService<Position<Bond>> HDSPOS("positions.txt");
+	RiskService<Bond> RS;
+	HistoricalDataService<PV01<Bond>> HDSRISK("risk.txt");
+
+	MarketDataService<Bond> MDS;
+	AlgoExecutionService<Bond> AES;
+	ExecutionService<Bond> ES;
+	HistoricalDataService<ExecutionOrder<Bond>> HDSE("executions.txt");
+
+	InquiryService<Bond> IQS;
+	HistoricalDataService<Inquiry<Bond>> HDSIQ("allinquiries.txt");
+
+	if (which == "all" || which == "prices")
+	{
+		FlowResult flow;
+		flow.name = "prices";
+		PS.AddListener(Timed(flow, "AlgoStreamingListener", ASS.GetListener()));
+		ASS.AddListener(Timed(flow, "StreamingListener", SS.GetListener()));
+		SS.AddListener(Timed(flow, "HistoricalDataListener(streaming.txt)", HDSPS.GetListener()));
+		PS.AddListener(Timed(flow, "GUIListener", GUIS.GetListener()));
+		PSConnector<Bond> psc(&PS, readMode);
+		RunFlow(flow, "PSConnector+PricingService", [&]() { psc.Consume("prices.txt"); return psc.GetStats().GetLines(); });
+		flows.push_back(flow);
+	}
+
+	// positions and risk also listen to the trades booked from executions
+	FlowResult tradeListeners;
+	TBS.AddListener(Timed(tradeListeners, "PositionListener", POSS.GetListener()));
+	POSS.AddListener(Timed(tradeListeners, "HistoricalDataListener(positions.txt)", HDSPOS.GetListener()));
+	POSS.AddListener(Timed(tradeListeners, "RiskListener", RS.GetListener()));
+	RS.AddListener(Timed(tradeListeners, "HistoricalDataListener(risk.txt)", HDSRISK.GetListener()));
+
+	if (which == "all" || which == "trades")
+	{
+		FlowResult flow;
+		flow.name = "trades";
+		TBSConnector<Bond> tbsc(&TBS, readMode);
+		RunFlow(flow, "TBSConnector+TradeBookingService", [&]() { tbsc.Consume("trades.txt"); return tbsc.GetStats().GetLines(); });
+		// report the trade listeners with the flow and start them over for the next one
+		for (auto stage : tradeListeners.stages)
+		{
+			StageTimes copy = *stage;
+			*stage = StageTimes();
+			stage->name = copy.name;
+			allStages.push_back(copy);
+			flow.stages.push_back(&allStages.back());
+		}
+		flows.push_back(flow);
+	}
+
+	if (which == "all" || which == "marketdata")
+	{
+		FlowResult flow;
+		flow.name = "marketdata";
+		MDS.AddListener(Timed(flow, "AEListener", AES.GetListener()));
+		AES.AddListener(Timed(flow, "EListener", ES.GetListener()));
+		ES.AddListener(Timed(flow, "HistoricalDataListener(executions.txt)", HDSE.GetListener()));
+		ES.AddListener(Timed(flow, "TBListener", TBS.GetListener()));
+		for (auto stage : tradeListeners.stages) flow.stages.push_back(stage);
+		MDConnector<Bond> mdc(&MDS, readMode, thread::hardware_concurrency());
+		RunFlow(flow, "MDConnector+MarketDataService", [&]() { mdc.Consume("marketdata.txt"); return mdc.GetStats().GetLines(); });
+		flows.push_back(flow);
+	}
+
+	if (which == "all" || which == "inquiries")
+	{
+		FlowResult flow;
+		flow.name = "inquiries";
+		IQS.AddListener(Timed(flow, "HistoricalDataListener(allinquiries.txt)", HDSIQ.GetListener()));
+		IQS.getConnector()->SetReadMode(readMode);
+		RunFlow(flow, "IQConnector+InquiryService", [&]() { IQS.getConnector()->Consume("inquiries.txt"); return IQS.getConnector()->GetStats().GetLines(); });
+		flows.push_back(flow);
+	}
+
+	if (flows.empty())
+	{
+		cout << "unknown flow " << which << endl;
+		return 1;
+	}
+
+	long messages = 0;
+	double seconds = 0;
+	for (auto& flow : flows)
+	{
+		Print(flow);
+		messages += flow.messages;
+		seconds += flow.seconds;
+	}
+	cout << "total: " << messages << " messages in " << seconds << " s, "
+		<< (long)PerSecond(messages, seconds) << " messages/sec" << endl;
+	WriteJSON(json, mode, flows);
+	return 0;
+}
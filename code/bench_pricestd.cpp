@@ -0,0 +1,72 @@
+// Microbenchmark of the fractional price parser.
+// Compares PriceSTD against the original find/substr/stod version.
+//
+// g++ -std=c++11 -O2 bench_pricestd.cpp -o bench_pricestd
+// ./bench_pricestd [number of prices]
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include "tools.h"
+
+using namespace std;
+
+// The original PriceSTD, kept here as the baseline.
+double PriceSTDOriginal(string stringPrice)
+{
+	int sep = stringPrice.find("-");
+	string Price100 = stringPrice.substr(0,sep);
+	string Price32 = stringPrice.substr(sep+1,2);
+	string Price8 = stringPrice.substr(sep+3,1);
+	if (Price8 == "+") Price8 = "4";
+	return stod(Price100) + stod(Price32) / 32.0 + stod(Price8) / 256.0;
+}
+
+template<typename F>
+double NanosPerPrice(const vector<string>& prices, int rounds, F parse, double& checksum)
+{
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (auto& p : prices)
+		{
+			checksum += parse(p);
+		}
+	}
+	double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	return ns / (double(prices.size()) * rounds);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+	int rounds = 5;
+
+	// random prices between 99-000 and 100-31+
+	mt19937 rng(42);
+	vector<string> prices;
+	prices.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		prices.push_back(PriceDTS(99 * TICKS_PER_POINT + rng() % 512));
+	}
+
+	for (auto& p : prices)
+	{
+		if (PriceSTD(p) != PriceSTDOriginal(p) * TICKS_PER_POINT)
+		{
+			cout << "mismatch on " << p << endl;
+			return 1;
+		}
+	}
+
+	double checksum = 0;
+	double original = NanosPerPrice(prices, rounds, [](const string& p) { return PriceSTDOriginal(p); }, checksum);
+	double current = NanosPerPrice(prices, rounds, [](const string& p) { return PriceSTD(p.data(), p.data() + p.size()); }, checksum);
+
+	cout << n << " prices x " << rounds << " rounds (checksum " << checksum << ")" << endl;
+	cout << "PriceSTD original: " << original << " ns/price" << endl;
+	cout << "PriceSTD:          " << current << " ns/price" << endl;
+	cout << "speedup:           " << original / current << "x" << endl;
+	return 0;
+}
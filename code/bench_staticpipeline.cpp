@@ -0,0 +1,125 @@
+// Benchmark of the price to stream chain wired with listeners against the
+// same services wired as a StaticPipeline (staticpipeline.h).
+// Both chains are fed through a PricingService, one price at a time and in
+// batches, and end in a sink counting the price streams (or in a
+// HistoricalDataService writing streaming_*.txt with "persist").
+//
+// g++ -std=c++11 -O2 bench_staticpipeline.cpp -o bench_staticpipeline
+// ./bench_staticpipeline [number of prices] [persist]
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include "staticpipeline.h"
+
+using namespace std;
+
+// Sums the bid of every price stream, to check both chains saw the same data
+long virtualChecksum = 0;
+long staticChecksum = 0;
+
+template<typename T>
+class CountingListener : public ServiceListener<PriceStream<T>>
+{
+
+public:
+
+	void ProcessAdd(PriceStream<T>& data) { virtualChecksum += data.GetBidOrder().GetPrice(); }
+	void ProcessRemove(PriceStream<T>& data) {}
+	void ProcessUpdate(PriceStream<T>& data) {}
+
+};
+
+template<typename T>
+class CountingStage
+{
+
+public:
+
+	typedef PriceStream<T> Input;
+	typedef void Output;
+
+	void Process(PriceStream<T>& data) { staticChecksum += data.GetBidOrder().GetPrice(); }
+	void ProcessBatch(PriceStream<T>* data, size_t n) { for (size_t i = 0; i < n; i++) Process(data[i]); }
+
+};
+
+// Feed all prices to a pricing service, one by one or in batches, and get ns/price
+double NanosPerPrice(PricingService<Bond>& service, vector<Price<Bond>>& prices, bool batch)
+{
+	auto start = chrono::steady_clock::now();
+	if (batch)
+	{
+		for (size_t i = 0; i < prices.size(); i += CONNECTOR_BATCH_SIZE)
+		{
+			service.OnMessageBatch(prices.data() + i, min(CONNECTOR_BATCH_SIZE, prices.size() - i));
+		}
+	}
+	else
+	{
+		for (auto& p : prices) service.OnMessage(p);
+	}
+	double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	return ns / prices.size();
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+	bool persist = argc > 2 && string(argv[2]) == "persist";
+
+	// random prices around par on all tickers
+	mt19937 rng(42);
+	vector<Price<Bond>> prices;
+	prices.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		TickPrice mid = 99 * TICKS_PER_POINT + rng() % 512;
+		prices.push_back(Price<Bond>(GetBond(PRODUCT_TICKERS[rng() % PRODUCT_COUNT]), mid, 2 + 2 * (rng() % 2)));
+	}
+
+	// listener chain
+	PricingService<Bond> PS;
+	AlgoStreamingService<Bond> ASS;
+	StreamingService<Bond> SS;
+	HistoricalDataService<PriceStream<Bond>> HDSV("streaming_virtual.txt");
+	CountingListener<Bond> counter;
+	PS.AddListener(ASS.GetListener());
+	ASS.AddListener(SS.GetListener());
+	if (persist) SS.AddListener(HDSV.GetListener());
+	else SS.AddListener(&counter);
+
+	// static pipeline over a second set of services
+	PricingService<Bond> PS2;
+	AlgoStreamingService<Bond> ASS2;
+	StreamingService<Bond> SS2;
+	HistoricalDataService<PriceStream<Bond>> HDSS("streaming_static.txt");
+	auto counting = MakePipeline(AlgoStreamingStage<Bond>(&ASS2), StreamingStage<Bond>(&SS2), CountingStage<Bond>());
+	auto persisting = MakePipeline(AlgoStreamingStage<Bond>(&ASS2), StreamingStage<Bond>(&SS2), HistoricalDataStage<PriceStream<Bond>>(&HDSS));
+	PipelineListener<decltype(counting)> countingListener(&counting);
+	PipelineListener<decltype(persisting)> persistingListener(&persisting);
+	if (persist) PS2.AddListener(&persistingListener);
+	else PS2.AddListener(&countingListener);
+
+	// best of a few interleaved rounds, the services' maps and the allocator are noisy
+	int rounds = persist ? 1 : 5;
+	for (int batch = 0; batch < 2; batch++)
+	{
+		double v = 1e30, s = 1e30;
+		for (int r = 0; r < rounds; r++)
+		{
+			v = min(v, NanosPerPrice(PS, prices, batch));
+			s = min(s, NanosPerPrice(PS2, prices, batch));
+		}
+		cout << (batch ? "batch:  " : "single: ") << "listeners " << v << " ns/price, static pipeline "
+			<< s << " ns/price" << endl;
+	}
+
+	if (virtualChecksum != staticChecksum)
+	{
+		cout << "checksum mismatch" << endl;
+		return 1;
+	}
+	return 0;
+}
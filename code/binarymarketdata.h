@@ -0,0 +1,138 @@
+#ifndef BINARYMARKETDATA_HPP
+#define BINARYMARKETDATA_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include "tools.h"
+#include "csvtokenizer.h"
+
+using namespace std;
+
+// Levels per side of a binary market data record
+const int MD_RECORD_DEPTH = 5;
+
+const char MD_FILE_MAGIC[4] = { 'M', 'D', 'B', '1' };
+
+/**
+* Header at the start of a binary market data file.
+*/
+struct MDFileHeader
+{
+	char magic[4];
+	uint32_t recordSize;
+	uint32_t depth;
+	uint32_t reserved;
+};
+
+/**
+* One order book snapshot of a binary market data file: a product index,
+* a timestamp, and MD_RECORD_DEPTH (price in ticks, size) levels per side,
+* best first. Levels of size 0 are empty. Records are fixed width and follow
+* the header back to back, in host (little endian) byte order.
+*/
+struct MDRecord
+{
+	int64_t timestamp;
+	int32_t productIndex;
+	int32_t reserved;
+	int32_t bidPrices[MD_RECORD_DEPTH];
+	int32_t offerPrices[MD_RECORD_DEPTH];
+	uint32_t bidSizes[MD_RECORD_DEPTH];
+	uint32_t offerSizes[MD_RECORD_DEPTH];
+};
+
+static_assert(sizeof(MDFileHeader) == 16, "MDFileHeader must be 16 bytes");
+static_assert(sizeof(MDRecord) == 96, "MDRecord must be 96 bytes");
+
+// Convert marketdata.txt to the binary format. marketdata.txt has no time
+// column, so each record is stamped with its line number. Lines of unknown
+// tickers or of sizes that do not fit 32 bits are skipped, and levels past
+// MD_RECORD_DEPTH are dropped.
+// Returns the number of records written, -1 if the input cannot be read or the
+// output cannot be opened or written. The output is left alone if the input cannot be read.
+long ConvertMarketData(const string& csv_file, const string& binary_file);
+
+// Check the header of a mapped binary market data file and get its records.
+// Returns the number of records, -1 if the file is not in this format.
+long GetMDRecords(const char* data, size_t size, const MDRecord*& records);
+
+
+
+
+/*    implementation     */
+long ConvertMarketData(const string& csv_file, const string& binary_file)
+{
+	// a directory opens, but fails its first read
+	ifstream in(csv_file, ios::binary);
+	in.peek();
+	if (!in.is_open() || in.bad()) return -1;
+	in.close();
+
+	ofstream out(binary_file, ios::binary | ios::trunc);
+	if (!out) return -1;
+
+	MDFileHeader header;
+	memcpy(header.magic, MD_FILE_MAGIC, 4);
+	header.recordSize = sizeof(MDRecord);
+	header.depth = MD_RECORD_DEPTH;
+	header.reserved = 0;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	long line = 0;
+	long written = 0;
+	vector<MDRecord> buffer;
+	buffer.reserve(4096);
+	ForEachRecord(csv_file, MAPPED_READ, [&](const FieldRef* blocks, size_t n) {
+		line++;
+		int depth = (n - 1) / 4;
+		int index = GetProductIndex(blocks[0].Begin(), blocks[0].End());
+		if (depth == 0 || index < 0) return;
+
+		MDRecord record;
+		memset(&record, 0, sizeof(record));
+		record.timestamp = line;
+		record.productIndex = index;
+		for (int i = 0; i < depth && i < MD_RECORD_DEPTH; i++)
+		{
+			const FieldRef* bid = blocks + 1 + 2 * i;
+			const FieldRef* offer = blocks + 1 + 2 * depth + 2 * i;
+			// a negative size wraps past 32 bits too
+			unsigned long bidSize = stoul(bid[1].ToString());
+			unsigned long offerSize = stoul(offer[1].ToString());
+			if (bidSize > UINT32_MAX || offerSize > UINT32_MAX) return;
+			record.bidPrices[i] = PriceSTD(bid[0].Begin(), bid[0].End());
+			record.bidSizes[i] = bidSize;
+			record.offerPrices[i] = PriceSTD(offer[0].Begin(), offer[0].End());
+			record.offerSizes[i] = offerSize;
+		}
+		buffer.push_back(record);
+		if (buffer.size() == buffer.capacity())
+		{
+			out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(MDRecord));
+			written += buffer.size();
+			buffer.clear();
+		}
+	});
+	out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(MDRecord));
+	written += buffer.size();
+	// a failed write (e.g. a full disk) leaves the stream failed
+	out.close();
+	return out ? written : -1;
+}
+
+long GetMDRecords(const char* data, size_t size, const MDRecord*& records)
+{
+	if (size < sizeof(MDFileHeader)) return -1;
+
+	const MDFileHeader* header = reinterpret_cast<const MDFileHeader*>(data);
+	if (memcmp(header->magic, MD_FILE_MAGIC, 4) != 0 ||
+		header->recordSize != sizeof(MDRecord) || header->depth != MD_RECORD_DEPTH)
+		return -1;
+
+	records = reinterpret_cast<const MDRecord*>(data + sizeof(MDFileHeader));
+	return (size - sizeof(MDFileHeader)) / sizeof(MDRecord);
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef BOOKHISTORY_HPP
+#define BOOKHISTORY_HPP
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "soa.hpp"
+#include "tools.h"
+
+using namespace std;
+
+/**
+* Listener keeping the last events of each product, e.g. the order books of
+* MarketDataService, with the time they came in.
+* Each product has a ring of capacity events, its times and its events in two
+* contiguous arrays, allocated on the product's first event. Lookups by time
+* are a binary search of the times, and iteration hands out references into
+* the ring: nothing is copied on the way out.
+* A product must be recorded from one thread at a time, and read from that
+* thread or once it is done (e.g. after ShardedMarketDataService::Flush).
+*/
+template<typename V>
+class BookHistory : public ServiceListener<V>
+{
+
+public:
+
+	// Keep the last _capacity events of each product
+	BookHistory(size_t _capacity);
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& data);
+
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(V* data, size_t n);
+
+	// Record an event of a product at a time, in nanoseconds on the clock of Now.
+	// The times of a product must not go back. The oldest event goes when the ring is full.
+	void Record(const V& data, uint64_t time);
+
+	// Get the number of events kept for a product
+	size_t Size(int productIndex) const;
+
+	// Get the newest event of a product at or before a time, nullptr if there is none
+	const V* AsOf(int productIndex, uint64_t time) const;
+
+	// Call fn(uint64_t time, const V& data) on the events of a product from time
+	// 'from' to time 'to', both included, oldest first
+	template<typename F>
+	void ForEach(int productIndex, uint64_t from, uint64_t to, F fn) const;
+
+	// Get the oldest and newest time kept for a product, 0 if there is none
+	uint64_t GetFirstTime(int productIndex) const;
+	uint64_t GetLastTime(int productIndex) const;
+
+	// Get the time now, in nanoseconds of the steady clock, which never goes back
+	// (unlike the wall clock), so that the times of a ring stay sorted
+	static uint64_t Now();
+
+private:
+	struct Ring
+	{
+		vector<uint64_t> times;
+		vector<V> data;
+		// position of the oldest event, and number of events
+		size_t head = 0;
+		size_t size = 0;
+	};
+
+	// Get the position in the ring of the i-th oldest event
+	size_t At(const Ring& ring, size_t i) const;
+
+	// Get the number of events of a ring at or before a time
+	size_t CountUpTo(const Ring& ring, uint64_t time) const;
+
+	size_t capacity;
+	// one ring per product index, and one for index -1
+	vector<Ring> rings;
+
+};
+
+
+
+
+/*    implementation     */
+template<typename V>
+BookHistory<V>::BookHistory(size_t _capacity)
+	:capacity(_capacity < 1 ? 1 : _capacity), rings(PRODUCT_COUNT + 1) {}
+
+template<typename V>
+void BookHistory<V>::ProcessAdd(V& data)
+{
+	Record(data, Now());
+}
+
+template<typename V>
+void BookHistory<V>::ProcessRemove(V& data) {}
+
+template<typename V>
+void BookHistory<V>::ProcessUpdate(V& data)
+{
+	Record(data, Now());
+}
+
+template<typename V>
+void BookHistory<V>::ProcessAddBatch(V* data, size_t n)
+{
+	// a batch comes in at once
+	uint64_t time = Now();
+	for (size_t i = 0; i < n; i++) Record(data[i], time);
+}
+
+template<typename V>
+void BookHistory<V>::Record(const V& data, uint64_t time)
+{
+	Ring& ring = rings[data.GetProduct().GetIndex() + 1];
+	if (ring.times.empty())
+	{
+		ring.times.resize(capacity);
+		ring.data.resize(capacity);
+	}
+
+	size_t position;
+	if (ring.size < capacity) position = At(ring, ring.size++);
+	else
+	{
+		position = ring.head;
+		ring.head = At(ring, 1);
+	}
+	ring.times[position] = time;
+	ring.data[position] = data;
+}
+
+template<typename V>
+size_t BookHistory<V>::Size(int productIndex) const
+{
+	return rings[productIndex + 1].size;
+}
+
+template<typename V>
+const V* BookHistory<V>::AsOf(int productIndex, uint64_t time) const
+{
+	const Ring& ring = rings[productIndex + 1];
+	size_t count = CountUpTo(ring, time);
+	return count == 0 ? nullptr : &ring.data[At(ring, count - 1)];
+}
+
+template<typename V>
+template<typename F>
+void BookHistory<V>::ForEach(int productIndex, uint64_t from, uint64_t to, F fn) const
+{
+	const Ring& ring = rings[productIndex + 1];
+	size_t end = CountUpTo(ring, to);
+	for (size_t i = from == 0 ? 0 : CountUpTo(ring, from - 1); i < end; i++)
+	{
+		size_t position = At(ring, i);
+		fn(ring.times[position], ring.data[position]);
+	}
+}
+
+template<typename V>
+uint64_t BookHistory<V>::GetFirstTime(int productIndex) const
+{
+	const Ring& ring = rings[productIndex + 1];
+	return ring.size == 0 ? 0 : ring.times[ring.head];
+}
+
+template<typename V>
+uint64_t BookHistory<V>::GetLastTime(int productIndex) const
+{
+	const Ring& ring = rings[productIndex + 1];
+	return ring.size == 0 ? 0 : ring.times[At(ring, ring.size - 1)];
+}
+
+template<typename V>
+uint64_t BookHistory<V>::Now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename V>
+size_t BookHistory<V>::At(const Ring& ring, size_t i) const
+{
+	size_t position = ring.head + i;
+	return position < capacity ? position : position - capacity;
+}
+
+template<typename V>
+size_t BookHistory<V>::CountUpTo(const Ring& ring, uint64_t time) const
+{
+	// times are sorted from the head on, so this is an upper bound over the ring
+	size_t low = 0;
+	size_t high = ring.size;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (ring.times[At(ring, middle)] <= time) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef CONFLATINGLISTENER_HPP
+#define CONFLATINGLISTENER_HPP
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "soa.hpp"
+#include "tools.h"
+
+using namespace std;
+
+/**
+* Listener keeping only the newest event of each product for a slow listener.
+* Events land in a slot table indexed by product index, and the products
+* updated since the last Drain are kept in a dirty list. Drain hands the
+* newest event of each of them to the wrapped listener, so a burst of ticks
+* costs it at most one event per product. Drain is called by the consumer at
+* its own pace, or by a timer thread every interval. Services may call it from
+* any thread; the wrapped listener is called from the thread draining.
+*/
+template<typename V>
+class ConflatingListener : public ServiceListener<V>
+{
+
+public:
+
+	// With an interval, a timer thread drains every intervalMillis milliseconds
+	ConflatingListener(ServiceListener<V>* _listener, int intervalMillis = 0);
+	~ConflatingListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& data);
+
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(V* data, size_t n);
+
+	// Pass on the newest event of every product updated since the last Drain.
+	// Adds go out as one ProcessAddBatch. Returns the number of events passed on.
+	size_t Drain();
+
+	// Get the number of events replaced by a newer one before they were drained
+	long GetConflated() const;
+
+private:
+	ConflatingListener(const ConflatingListener&);
+	ConflatingListener& operator=(const ConflatingListener&);
+
+	enum EventType { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+	struct Slot
+	{
+		V data;
+		EventType type;
+		bool dirty = false;
+	};
+
+	void Store(EventType type, V& data);
+	// Store an event, slotsMutex held
+	void Replace(EventType type, V& data);
+	void RunTimer();
+
+	ServiceListener<V>* listener;
+	mutable mutex slotsMutex;
+	ProductTable<Slot> slots;
+	vector<int> dirty;
+	long conflated;
+	// one Drain at a time, so that the events of a product stay in order
+	mutex drainMutex;
+	vector<V> adds;
+	vector<Slot> others;
+
+	int interval;
+	atomic<bool> stopping;
+	thread timer;
+
+};
+
+
+
+
+/*    implementation     */
+template<typename V>
+ConflatingListener<V>::ConflatingListener(ServiceListener<V>* _listener, int intervalMillis)
+	:listener(_listener), conflated(0), interval(intervalMillis), stopping(false)
+{
+	dirty.reserve(PRODUCT_COUNT + 1);
+	if (interval > 0) timer = thread(&ConflatingListener<V>::RunTimer, this);
+}
+
+template<typename V>
+ConflatingListener<V>::~ConflatingListener()
+{
+	stopping.store(true);
+	if (timer.joinable()) timer.join();
+	Drain();
+}
+
+template<typename V>
+void ConflatingListener<V>::ProcessAdd(V& data)
+{
+	Store(ADD_EVENT, data);
+}
+
+template<typename V>
+void ConflatingListener<V>::ProcessRemove(V& data)
+{
+	Store(REMOVE_EVENT, data);
+}
+
+template<typename V>
+void ConflatingListener<V>::ProcessUpdate(V& data)
+{
+	Store(UPDATE_EVENT, data);
+}
+
+template<typename V>
+void ConflatingListener<V>::ProcessAddBatch(V* data, size_t n)
+{
+	// the newest of each product in the batch wins, under one lock
+	lock_guard<mutex> lock(slotsMutex);
+	for (size_t i = 0; i < n; i++) Replace(ADD_EVENT, data[i]);
+}
+
+template<typename V>
+size_t ConflatingListener<V>::Drain()
+{
+	lock_guard<mutex> drainLock(drainMutex);
+	adds.clear();
+	others.clear();
+	{
+		// copy the events out, the listener runs without holding up the services
+		lock_guard<mutex> lock(slotsMutex);
+		for (int index : dirty)
+		{
+			Slot& slot = slots[index];
+			slot.dirty = false;
+			if (slot.type == ADD_EVENT) adds.push_back(slot.data);
+			else others.push_back(slot);
+		}
+		dirty.clear();
+	}
+
+	if (!adds.empty()) listener->ProcessAddBatch(adds.data(), adds.size());
+	for (auto& slot : others)
+	{
+		if (slot.type == REMOVE_EVENT) listener->ProcessRemove(slot.data);
+		else listener->ProcessUpdate(slot.data);
+	}
+	return adds.size() + others.size();
+}
+
+template<typename V>
+long ConflatingListener<V>::GetConflated() const
+{
+	lock_guard<mutex> lock(slotsMutex);
+	return conflated;
+}
+
+template<typename V>
+void ConflatingListener<V>::Store(EventType type, V& data)
+{
+	lock_guard<mutex> lock(slotsMutex);
+	Replace(type, data);
+}
+
+template<typename V>
+void ConflatingListener<V>::Replace(EventType type, V& data)
+{
+	int index = data.GetProduct().GetIndex();
+	Slot& slot = slots[index];
+	slot.data = data;
+	slot.type = type;
+	if (slot.dirty) conflated++;
+	else
+	{
+		slot.dirty = true;
+		dirty.push_back(index);
+	}
+}
+
+template<typename V>
+void ConflatingListener<V>::RunTimer()
+{
+	auto next = chrono::steady_clock::now();
+	while (!stopping.load())
+	{
+		next += chrono::milliseconds(interval);
+		// short sleeps, so that the destructor does not wait a whole interval
+		while (!stopping.load() && chrono::steady_clock::now() < next)
+		{
+			this_thread::sleep_until(min(next, chrono::steady_clock::now() + chrono::milliseconds(10)));
+		}
+		Drain();
+	}
+}
+
+#endif
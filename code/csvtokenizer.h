@@ -0,0 +1,236 @@
+#ifndef CSVTOKENIZER_HPP
+#define CSVTOKENIZER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "filereader.h"
+
+// Build with -DCSV_NO_SIMD to force the scalar scanner.
+#if !defined(CSV_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define CSV_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Bytes of a mapped file tokenized at once
+const size_t CSV_CHUNK_SIZE = 1 << 20;
+
+/**
+* CSV tokenizer shared by the file connectors.
+* Tokenize finds every ',' and '\n' of a buffer (32 or 16 bytes at a time with
+* AVX2/SSE2 compare masks, byte by byte otherwise) and records the fields of
+* all its lines at once. A '\r' before the '\n' is trimmed and blank lines are skipped.
+* Fields point into the tokenized buffer, which must outlive them.
+*/
+class CSVTokenizer
+{
+
+public:
+
+	CSVTokenizer();
+
+	// Tokenize a buffer, replacing the previous result. Returns the number of records.
+	size_t Tokenize(const char* _data, size_t _size);
+
+	// Get the number of records of the last buffer
+	size_t GetRecordCount() const;
+
+	// Get the number of fields of a record
+	size_t GetFieldCount(size_t record) const;
+
+	// Get the fields of a record
+	const FieldRef* GetFields(size_t record) const;
+
+private:
+
+	void ScanScalar(size_t from);
+#ifdef CSV_SIMD_X86
+	void ScanSSE2();
+	__attribute__((target("avx2"))) void ScanAVX2();
+#endif
+
+	void AddDelimiter(size_t pos);
+	void EndRecord();
+	void EndBuffer();
+
+	const char* data;
+	size_t size;
+	size_t fieldStart;
+	vector<FieldRef> fields;
+	// records[i] is the index of the first field of record i, plus a closing entry
+	vector<size_t> records;
+
+};
+
+// Feed every record of a file to fn(const FieldRef* fields, size_t n).
+// STREAM_READ tokenizes line by line from getline, MAPPED_READ tokenizes the
+// mapped file a chunk at a time. Returns the number of records.
+template<typename F>
+long ForEachRecord(const string& file_name, ReadMode mode, F fn);
+
+
+
+
+/*    implementation     */
+CSVTokenizer::CSVTokenizer()
+	:data(nullptr), size(0), fieldStart(0) {}
+
+size_t CSVTokenizer::Tokenize(const char* _data, size_t _size)
+{
+	data = _data;
+	size = _size;
+	fieldStart = 0;
+	fields.clear();
+	records.clear();
+	records.push_back(0);
+
+#ifdef CSV_SIMD_X86
+	static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+	if (hasAVX2) ScanAVX2();
+	else ScanSSE2();
+#else
+	ScanScalar(0);
+#endif
+
+	EndBuffer();
+	return GetRecordCount();
+}
+
+size_t CSVTokenizer::GetRecordCount() const
+{
+	return records.size() - 1;
+}
+
+size_t CSVTokenizer::GetFieldCount(size_t record) const
+{
+	return records[record + 1] - records[record];
+}
+
+const FieldRef* CSVTokenizer::GetFields(size_t record) const
+{
+	return fields.data() + records[record];
+}
+
+void CSVTokenizer::ScanScalar(size_t from)
+{
+	for (size_t i = from; i < size; i++)
+	{
+		if (data[i] == ',' || data[i] == '\n') AddDelimiter(i);
+	}
+}
+
+#ifdef CSV_SIMD_X86
+void CSVTokenizer::ScanSSE2()
+{
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i newline = _mm_set1_epi8('\n');
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, newline)));
+		while (mask)
+		{
+			AddDelimiter(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	ScanScalar(i);
+}
+
+void CSVTokenizer::ScanAVX2()
+{
+	const __m256i comma = _mm256_set1_epi8(',');
+	const __m256i newline = _mm256_set1_epi8('\n');
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(block, comma), _mm256_cmpeq_epi8(block, newline)));
+		while (mask)
+		{
+			AddDelimiter(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	ScanScalar(i);
+}
+#endif
+
+void CSVTokenizer::AddDelimiter(size_t pos)
+{
+	size_t end = pos;
+	if (data[pos] == '\n' && end > fieldStart && data[end - 1] == '\r') end--;
+	fields.push_back(FieldRef(data + fieldStart, end - fieldStart));
+	fieldStart = pos + 1;
+	if (data[pos] == '\n') EndRecord();
+}
+
+void CSVTokenizer::EndRecord()
+{
+	// a blank line is a single empty field
+	if (fields.size() - records.back() == 1 && fields.back().Size() == 0)
+	{
+		fields.pop_back();
+		return;
+	}
+	records.push_back(fields.size());
+}
+
+void CSVTokenizer::EndBuffer()
+{
+	// last line without a '\n'
+	if (fieldStart < size || fields.size() > records.back())
+	{
+		size_t end = size;
+		if (end > fieldStart && data[end - 1] == '\r') end--;
+		fields.push_back(FieldRef(data + fieldStart, end - fieldStart));
+		fieldStart = size;
+		EndRecord();
+	}
+}
+
+
+template<typename F>
+long ForEachRecord(const string& file_name, ReadMode mode, F fn)
+{
+	CSVTokenizer tokenizer;
+	long records = 0;
+
+	if (mode == STREAM_READ)
+	{
+		ifstream file(file_name);
+		string line;
+		while (getline(file, line))
+		{
+			size_t n = tokenizer.Tokenize(line.data(), line.size());
+			for (size_t i = 0; i < n; i++)
+			{
+				fn(tokenizer.GetFields(i), tokenizer.GetFieldCount(i));
+			}
+			records += n;
+		}
+		return records;
+	}
+
+	MappedFile file(file_name);
+	const char* pos = file.Data();
+	const char* end = pos + file.Size();
+	FieldRef chunk;
+	while (NextChunk(pos, end, CSV_CHUNK_SIZE, chunk))
+	{
+		size_t n = tokenizer.Tokenize(chunk.Begin(), chunk.Size());
+		for (size_t i = 0; i < n; i++)
+		{
+			fn(tokenizer.GetFields(i), tokenizer.GetFieldCount(i));
+		}
+		records += n;
+	}
+	return records;
+}
+
+#endif
@@ -0,0 +1,365 @@
+// Generate prices.txt, trades.txt, marketdata.txt and inquiries.txt in the
+// formats the connectors read, from a seeded random walk per ticker.
+// With --updates, also marketupdates.txt: level events on a book per ticker.
+//
+// g++ -std=c++11 -O2 datagen.cpp -o datagen
+// ./datagen [--seed 1] [--prices 1000000] [--trades 60] [--marketdata 1000000]
+//           [--inquiries 60] [--tickers T2Y,T3Y,T5Y,T7Y,T10Y,T20Y,T30Y]
+//           [--depth 5] [--updates 0] [--out .]
+//
+// Each ticker's mid starts near par and moves by a few ticks per update
+// (normal steps, kept above 50 points). Prices.txt spreads are 1/128 or 1/64,
+// market data top-of-book spreads are 1/128 to 1/32 so that the algo
+// execution signal fires on part of the books.
+// Level events carry on from the last book of each ticker in marketdata.txt
+// (tickers without one first get depth levels a side added, on top of the
+// --updates lines). They mostly change the size of a level, and now and then
+// move a side by a tick: the best level goes and a new worst one comes, or
+// the other way round.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include "tools.h"
+
+using namespace std;
+
+/**
+* Buffered writer for one generated file.
+* If the file cannot be opened or written, datagen stops with status 1.
+*/
+class DataFile
+{
+
+public:
+
+	DataFile(const string& file_name);
+	~DataFile();
+
+	DataFile& operator<<(const string& s);
+	DataFile& operator<<(long v);
+	DataFile& operator<<(char c);
+
+private:
+	void Flush();
+
+	// Report that the file cannot be opened or written, and exit with status 1
+	void Fail();
+
+	ofstream file;
+	string name;
+	string buffer;
+
+};
+
+/**
+* Random walk of the mid price of each ticker, in ticks.
+*/
+class PriceWalk
+{
+
+public:
+
+	PriceWalk(int tickers, mt19937_64& _rng);
+
+	// Move the mid of a ticker one step and get it
+	TickPrice Step(int ticker);
+
+private:
+	mt19937_64& rng;
+	normal_distribution<double> step;
+	vector<TickPrice> mids;
+
+};
+
+struct Options
+{
+	unsigned long seed = 1;
+	long prices = 1000000;
+	long trades = 60;
+	long marketdata = 1000000;
+	long inquiries = 60;
+	long updates = 0;
+	int depth = 5;
+	string out = ".";
+	vector<string> tickers = vector<string>(PRODUCT_TICKERS, PRODUCT_TICKERS + PRODUCT_COUNT);
+};
+
+// Price levels of the book of a ticker, best first
+struct Levels
+{
+	deque<TickPrice> bids;
+	deque<TickPrice> offers;
+};
+
+
+
+
+/*    implementation     */
+DataFile::DataFile(const string& file_name)
+	:file(file_name, ios::binary | ios::trunc), name(file_name)
+{
+	if (!file) Fail();
+	buffer.reserve(1 << 20);
+}
+
+DataFile::~DataFile()
+{
+	Flush();
+	file.close();
+	if (!file) Fail();
+}
+
+DataFile& DataFile::operator<<(const string& s)
+{
+	buffer += s;
+	if (buffer.size() >= (1 << 20)) Flush();
+	return *this;
+}
+
+DataFile& DataFile::operator<<(long v)
+{
+	return *this << to_string(v);
+}
+
+DataFile& DataFile::operator<<(char c)
+{
+	buffer += c;
+	if (c == '\n' && buffer.size() >= (1 << 20)) Flush();
+	return *this;
+}
+
+void DataFile::Flush()
+{
+	file.write(buffer.data(), buffer.size());
+	buffer.clear();
+	if (!file) Fail();
+}
+
+void DataFile::Fail()
+{
+	// stop before main says the files were written
+	cout << "cannot write " << name << endl;
+	exit(1);
+}
+
+PriceWalk::PriceWalk(int tickers, mt19937_64& _rng)
+	:rng(_rng), step(0.0, 2.0)
+{
+	uniform_int_distribution<TickPrice> start(99 * TICKS_PER_POINT, 101 * TICKS_PER_POINT);
+	for (int i = 0; i < tickers; i++)
+	{
+		mids.push_back(start(rng));
+	}
+}
+
+TickPrice PriceWalk::Step(int ticker)
+{
+	TickPrice& mid = mids[ticker];
+	mid += lround(step(rng));
+	if (mid < 50 * TICKS_PER_POINT) mid = 50 * TICKS_PER_POINT;
+	return mid;
+}
+
+string RandomId(mt19937_64& rng, int len)
+{
+	static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	string id(len, '0');
+	for (auto& c : id) c = alphanum[rng() % 36];
+	return id;
+}
+
+void WritePrices(const Options& o, mt19937_64& rng)
+{
+	DataFile file(o.out + "/prices.txt");
+	PriceWalk walk(o.tickers.size(), rng);
+	for (long i = 0; i < o.prices; i++)
+	{
+		int t = rng() % o.tickers.size();
+		TickPrice spread = (rng() % 2) ? 2 : 4;
+		TickPrice bid = walk.Step(t) - spread / 2;
+		file << o.tickers[t] << ',' << PriceDTS(bid) << ',' << PriceDTS(bid + spread) << '\n';
+	}
+}
+
+// Books holds the last book written for each ticker
+void WriteMarketData(const Options& o, mt19937_64& rng, vector<Levels>& books)
+{
+	DataFile file(o.out + "/marketdata.txt");
+	PriceWalk walk(o.tickers.size(), rng);
+	for (long i = 0; i < o.marketdata; i++)
+	{
+		int t = rng() % o.tickers.size();
+		TickPrice spread = 2 * (1 + rng() % 4);
+		TickPrice bid = walk.Step(t) - spread / 2;
+		file << o.tickers[t];
+		for (int level = 0; level < o.depth; level++)
+		{
+			file << ',' << PriceDTS(bid - level) << ',' << (level + 1) * 10000000L;
+		}
+		for (int level = 0; level < o.depth; level++)
+		{
+			file << ',' << PriceDTS(bid + spread + level) << ',' << (level + 1) * 10000000L;
+		}
+		file << '\n';
+		books[t].bids.clear();
+		books[t].offers.clear();
+		for (int level = 0; level < o.depth; level++)
+		{
+			books[t].bids.push_back(bid - level);
+			books[t].offers.push_back(bid + spread + level);
+		}
+	}
+}
+
+void WriteUpdates(const Options& o, mt19937_64& rng, vector<Levels>& books)
+{
+	DataFile file(o.out + "/marketupdates.txt");
+	uniform_int_distribution<TickPrice> start(99 * TICKS_PER_POINT, 101 * TICKS_PER_POINT);
+	long lines = 0;
+	auto write = [&](int t, bool bid, const char* action, TickPrice price, long size) {
+		lines++;
+		file << o.tickers[t] << (bid ? ",BID," : ",OFFER,") << action << ',' << PriceDTS(price) << ',' << size << '\n';
+	};
+
+	for (size_t t = 0; t < o.tickers.size(); t++)
+	{
+		if (!books[t].bids.empty()) continue;
+		TickPrice bid = start(rng);
+		for (int level = 0; level < o.depth; level++)
+		{
+			books[t].bids.push_back(bid - level);
+			books[t].offers.push_back(bid + 2 + level);
+			write(t, true, "ADD", bid - level, (level + 1) * 10000000L);
+			write(t, false, "ADD", bid + 2 + level, (level + 1) * 10000000L);
+		}
+	}
+
+	// o.updates lines after the ADDs above; a move takes two
+	lines = 0;
+	while (lines < o.updates)
+	{
+		int t = rng() % o.tickers.size();
+		bool bid = rng() % 2;
+		deque<TickPrice>& side = bid ? books[t].bids : books[t].offers;
+		TickPrice step = bid ? 1 : -1;
+		if (rng() % 4 || lines + 1 == o.updates)
+		{
+			write(t, bid, "MODIFY", side[rng() % side.size()], (1 + rng() % 10) * 10000000L);
+			continue;
+		}
+		// move in, unless the spread is down to a tick, or out
+		TickPrice other = bid ? books[t].offers.front() : books[t].bids.front();
+		if (rng() % 2 && (other - side.front()) * step > 1)
+		{
+			TickPrice best = side.front() + step;
+			write(t, bid, "DELETE", side.back(), 0);
+			side.pop_back();
+			side.push_front(best);
+			write(t, bid, "ADD", best, 10000000L);
+		}
+		else
+		{
+			TickPrice worst = side.back() - step;
+			write(t, bid, "DELETE", side.front(), 0);
+			side.pop_front();
+			side.push_back(worst);
+			write(t, bid, "ADD", worst, (long)o.depth * 10000000L);
+		}
+	}
+}
+
+void WriteTrades(const Options& o, mt19937_64& rng)
+{
+	DataFile file(o.out + "/trades.txt");
+	PriceWalk walk(o.tickers.size(), rng);
+	for (long i = 0; i < o.trades; i++)
+	{
+		int t = rng() % o.tickers.size();
+		file << o.tickers[t] << ',' << RandomId(rng, 12) << ',' << string(i % 2 ? "Sell" : "Buy") << ','
+			<< PriceDTS(walk.Step(t)) << ',' << (i % 5 + 1) * 1000000L << ",TRSY" << (i % 3 + 1) << '\n';
+	}
+}
+
+void WriteInquiries(const Options& o, mt19937_64& rng)
+{
+	DataFile file(o.out + "/inquiries.txt");
+	PriceWalk walk(o.tickers.size(), rng);
+	for (long i = 0; i < o.inquiries; i++)
+	{
+		int t = rng() % o.tickers.size();
+		file << o.tickers[t] << ',' << RandomId(rng, 12) << ',' << string(i % 2 ? "Sell" : "Buy") << ','
+			<< PriceDTS(walk.Step(t)) << ',' << (i % 5 + 1) * 1000000L << ",RECEIVED\n";
+	}
+}
+
+bool ParseOptions(int argc, char* argv[], Options& o)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		string key = argv[i];
+		string value = argv[i + 1];
+		if (key == "--seed") o.seed = stoul(value);
+		else if (key == "--prices") o.prices = stol(value);
+		else if (key == "--trades") o.trades = stol(value);
+		else if (key == "--marketdata") o.marketdata = stol(value);
+		else if (key == "--inquiries") o.inquiries = stol(value);
+		else if (key == "--depth") o.depth = stoi(value);
+		else if (key == "--updates") o.updates = stol(value);
+		else if (key == "--out") o.out = value;
+		else if (key == "--tickers")
+		{
+			o.tickers.clear();
+			stringstream list(value);
+			string ticker;
+			while (getline(list, ticker, ','))
+			{
+				if (GetProductIndex(ticker) < 0)
+				{
+					cout << "unknown ticker " << ticker << endl;
+					return false;
+				}
+				o.tickers.push_back(ticker);
+			}
+		}
+		else
+		{
+			cout << "unknown option " << key << endl;
+			return false;
+		}
+	}
+	if (argc % 2 == 0)
+	{
+		cout << "missing value for " << argv[argc - 1] << endl;
+		return false;
+	}
+	return !o.tickers.empty() && o.depth > 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Options o;
+	if (!ParseOptions(argc, argv, o)) return 1;
+
+	// one generator per file so that each file only depends on the seed and its own options
+	mt19937_64 pricesRng(o.seed), tradesRng(o.seed + 1), marketdataRng(o.seed + 2), inquiriesRng(o.seed + 3);
+	mt19937_64 updatesRng(o.seed + 4);
+	WritePrices(o, pricesRng);
+	WriteTrades(o, tradesRng);
+	vector<Levels> books(o.tickers.size());
+	WriteMarketData(o, marketdataRng, books);
+	WriteInquiries(o, inquiriesRng);
+	if (o.updates > 0) WriteUpdates(o, updatesRng, books);
+
+	cout << o.prices << " prices, " << o.trades << " trades, " << o.marketdata << " books, "
+		<< o.inquiries << " inquiries";
+	if (o.updates > 0) cout << ", " << o.updates << " level events";
+	cout << " written to " << o.out << endl;
+	return 0;
+}
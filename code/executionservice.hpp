@@ -11,8 +11,8 @@
 #include "soa.hpp"
 #include "marketdataservice.hpp"
 #include "algoexecutionservice.h"
-#include <unordered_map>
 #include "tools.h"
+#include "metrics.h"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
@@ -30,7 +30,7 @@ public:
 
   // ctor for an order
 	ExecutionOrder() = default;
-  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, TickPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
 
   // Get the product
   const T& GetProduct() const;
@@ -42,7 +42,7 @@ public:
   OrderType GetOrderType() const;
 
   // Get the price on this order
-  double GetPrice() const;
+  TickPrice GetPrice() const;
 
   // Get the visible quantity on this order
   long GetVisibleQuantity() const;
@@ -63,11 +63,11 @@ public:
   //string to print
   string To_string();
 private:
-  T product;
+  ProductRef<T> product;
   PricingSide side;
   string orderId;
   OrderType orderType;
-  double price;
+  TickPrice price;
   double visibleQuantity;
   double hiddenQuantity;
   string parentOrderId;
@@ -124,16 +124,17 @@ class ExecutionService : public Service<string, ExecutionOrder <T> >
 
 private:
 
-	unordered_map<string, ExecutionOrder<T>> executionOrders;
+	ProductTable<ExecutionOrder<T>> executionOrders;
 	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
 	EListener<T>* listener;
+	ServiceMetrics metrics;
 
 public:
 
 	// Constructor and destructor
 	ExecutionService();
 	// Get data on our service given a key
-	ExecutionOrder<T>& GetData(string key);
+	ExecutionOrder<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(ExecutionOrder<T>& data);
@@ -155,7 +156,7 @@ public:
 /*    implementation      */
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, TickPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
 	product(_product)
 {
 	side = _side;
@@ -171,7 +172,7 @@ ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _
 template<typename T>
 const T& ExecutionOrder<T>::GetProduct() const
 {
-	return product;
+	return product.Get();
 }
 
 template<typename T>
@@ -187,7 +188,7 @@ OrderType ExecutionOrder<T>::GetOrderType() const
 }
 
 template<typename T>
-double ExecutionOrder<T>::GetPrice() const
+TickPrice ExecutionOrder<T>::GetPrice() const
 {
 	return price;
 }
@@ -278,7 +279,7 @@ string ExecutionOrder<T>::To_string()
 	}
 	string _IsChildOrder = "IsChildOrder";
 	if (!isChildOrder) _IsChildOrder = "NotChildOrder";
-	return product.GetTicker() + ' ' + orderId + ' ' + _market + ' ' + 
+	return product->GetTicker() + ' ' + orderId + ' ' + _market + ' ' + 
 		_side + ' ' + _orderType
 		+ ' ' + PriceDTS(price) + ' ' + to_string(visibleQuantity)
 		+ ' ' + to_string(hiddenQuantity) + ' '
@@ -307,19 +308,21 @@ void EListener<T>::ProcessUpdate(AlgoExecution<T>& data) {}
 
 template<typename T>
 ExecutionService<T>::ExecutionService()
-	:listener(new EListener<T>(this)) {}
+	:listener(new EListener<T>(this)), metrics("ExecutionService") {}
 
 
 template<typename T>
-ExecutionOrder<T>& ExecutionService<T>::GetData(string key)
+ExecutionOrder<T>& ExecutionService<T>::GetData(const string& key)
 {
-	return executionOrders[key];
+	return executionOrders[GetProductIndex(key)];
 }
 
 template<typename T>
 void ExecutionService<T>::OnMessage(ExecutionOrder<T>& data)
 {
-	executionOrders[data.GetProduct().GetTicker()] = data;
+	executionOrders[data.GetProduct().GetIndex()] = data;
+	metrics.In();
+	metrics.SetSize(executionOrders.Size());
 }
 
 template<typename T>
@@ -346,6 +349,7 @@ void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& order, Market market)
 	order.setMarket(market);
 	OnMessage(order);
 
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(order);
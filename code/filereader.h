@@ -0,0 +1,257 @@
+#ifndef FILEREADER_HPP
+#define FILEREADER_HPP
+
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <fstream>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// How a file connector reads its input file.
+// STREAM_READ: getline into a string per line (the original path).
+// MAPPED_READ: memory map the whole file and walk it in place.
+enum ReadMode { STREAM_READ, MAPPED_READ };
+
+/**
+* A non-owning view of a run of characters inside a buffer.
+* Fields of a tokenized buffer are handed out as FieldRef so that no string
+* is built per line or per field.
+*/
+class FieldRef
+{
+
+public:
+
+	FieldRef();
+	FieldRef(const char* _ptr, size_t _len);
+
+	const char* Begin() const;
+	const char* End() const;
+	size_t Size() const;
+
+	// Compare with a null terminated string
+	bool operator==(const char* s) const;
+	bool operator!=(const char* s) const;
+
+	// Copy the field out (short fields stay in the small string buffer)
+	string ToString() const;
+
+private:
+	const char* ptr;
+	size_t len;
+
+};
+
+/**
+* Read-only memory map of a whole file.
+* An unreadable or empty file gives an empty map, matching how ifstream
+* silently reads nothing from a missing file.
+*/
+class MappedFile
+{
+
+public:
+
+	MappedFile(const string& file_name);
+	~MappedFile();
+
+	const char* Data() const;
+	size_t Size() const;
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	vector<char> buffer;
+#endif
+
+};
+
+/**
+* Line and wall time counters of one Consume call, used to compare reader modes.
+*/
+class IngestStats
+{
+
+public:
+
+	IngestStats();
+
+	void Start();
+	void Stop(long _lines);
+
+	long GetLines() const;
+	double GetSeconds() const;
+	double GetLinesPerSecond() const;
+
+	//string to print
+	string To_string() const;
+
+private:
+	chrono::steady_clock::time_point start;
+	long lines;
+	double seconds;
+
+};
+
+// Take the next chunk of about chunkSize bytes out of [pos, end), extended to
+// the end of its last line, and advance pos. Returns false once the buffer is exhausted.
+bool NextChunk(const char*& pos, const char* end, size_t chunkSize, FieldRef& chunk);
+
+
+
+
+/*    implementation     */
+FieldRef::FieldRef()
+	:ptr(nullptr), len(0) {}
+
+FieldRef::FieldRef(const char* _ptr, size_t _len)
+	:ptr(_ptr), len(_len) {}
+
+const char* FieldRef::Begin() const
+{
+	return ptr;
+}
+
+const char* FieldRef::End() const
+{
+	return ptr + len;
+}
+
+size_t FieldRef::Size() const
+{
+	return len;
+}
+
+bool FieldRef::operator==(const char* s) const
+{
+	return strlen(s) == len && memcmp(ptr, s, len) == 0;
+}
+
+bool FieldRef::operator!=(const char* s) const
+{
+	return !(*this == s);
+}
+
+string FieldRef::ToString() const
+{
+	return string(ptr, len);
+}
+
+
+#ifndef _WIN32
+MappedFile::MappedFile(const string& file_name)
+	:data(nullptr), size(0)
+{
+	int fd = open(file_name.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			data = static_cast<const char*>(p);
+			size = st.st_size;
+		}
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data) munmap(const_cast<char*>(data), size);
+}
+#else
+MappedFile::MappedFile(const string& file_name)
+	:data(nullptr), size(0)
+{
+	ifstream file(file_name, ios::binary);
+	buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	if (!buffer.empty())
+	{
+		data = buffer.data();
+		size = buffer.size();
+	}
+}
+
+MappedFile::~MappedFile() {}
+#endif
+
+const char* MappedFile::Data() const
+{
+	return data;
+}
+
+size_t MappedFile::Size() const
+{
+	return size;
+}
+
+
+IngestStats::IngestStats()
+	:lines(0), seconds(0) {}
+
+void IngestStats::Start()
+{
+	start = chrono::steady_clock::now();
+}
+
+void IngestStats::Stop(long _lines)
+{
+	lines = _lines;
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+long IngestStats::GetLines() const
+{
+	return lines;
+}
+
+double IngestStats::GetSeconds() const
+{
+	return seconds;
+}
+
+double IngestStats::GetLinesPerSecond() const
+{
+	if (seconds <= 0) return 0;
+	return lines / seconds;
+}
+
+string IngestStats::To_string() const
+{
+	return to_string(lines) + " lines in " + to_string(seconds) + " s, " +
+		to_string((long)GetLinesPerSecond()) + " lines/sec";
+}
+
+
+bool NextChunk(const char*& pos, const char* end, size_t chunkSize, FieldRef& chunk)
+{
+	if (pos >= end) return false;
+
+	const char* stop = end;
+	if ((size_t)(end - pos) > chunkSize)
+	{
+		const char* eol = static_cast<const char*>(memchr(pos + chunkSize, '\n', end - pos - chunkSize));
+		if (eol) stop = eol + 1;
+	}
+	chunk = FieldRef(pos, stop - pos);
+	pos = stop;
+	return true;
+}
+
+#endif
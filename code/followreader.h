@@ -0,0 +1,250 @@
+#ifndef FOLLOWREADER_HPP
+#define FOLLOWREADER_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "csvtokenizer.h"
+
+using namespace std;
+
+/**
+* Reads an input as it is being written.
+* A regular file is read to its end and then followed: inotify wakes the
+* reader when data is appended, until Stop/StopAll or the file is deleted or
+* moved away. A named pipe, or stdin for "-", is read until its writer closes it.
+* Waiting is done in poll(), never by sleeping. Without inotify (non Linux)
+* a regular file is only read up to its current end.
+*/
+class FollowReader
+{
+
+public:
+
+	FollowReader(const string& file_name);
+	~FollowReader();
+
+	// Read up to cap bytes, waiting for them if needed. Returns 0 at the end of the input.
+	size_t Next(char* buf, size_t cap);
+
+	// End this reader. Safe to call from any thread.
+	void Stop();
+
+	// End every reader alive now, through its own stop pipe; readers made later are
+	// not affected. Safe to call from a signal handler.
+	static void StopAll();
+
+private:
+	FollowReader(const FollowReader&);
+	FollowReader& operator=(const FollowReader&);
+
+	// Block until the input or a stop request needs attention. False once stopped.
+	bool Wait();
+
+	// Readers StopAll can reach. More readers than that can only be ended with Stop.
+	static const int MAX_READERS = 64;
+
+	// Get the write ends of the stop pipes of the live readers, plus one; 0 for a free slot.
+	// Zero initialized before anything runs, so a signal handler can read it.
+	static atomic<int>* Readers();
+
+	int fd;
+	int watchFd;
+	bool regular;
+	bool finishing;
+	int stopPipe[2];
+	int slot;
+
+};
+
+// Feed every complete record of a followed input to fn(const FieldRef* fields, size_t n)
+// as it arrives. Returns the number of records once the input ends.
+template<typename F>
+long FollowRecords(FollowReader& reader, F fn);
+
+
+
+
+/*    implementation     */
+FollowReader::FollowReader(const string& file_name)
+	:fd(-1), watchFd(-1), regular(false), finishing(false), slot(-1)
+{
+	if (pipe(stopPipe) != 0) stopPipe[0] = stopPipe[1] = -1;
+	for (int i = 0; stopPipe[1] >= 0 && i < MAX_READERS && slot < 0; i++)
+	{
+		int expected = 0;
+		if (Readers()[i].compare_exchange_strong(expected, stopPipe[1] + 1)) slot = i;
+	}
+
+	if (file_name == "-")
+	{
+		fd = dup(STDIN_FILENO);
+		return;
+	}
+
+	// non blocking so that opening a pipe does not wait for its writer
+	fd = open(file_name.c_str(), O_RDONLY | O_NONBLOCK);
+	if (fd < 0) return;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+	struct stat st;
+	regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+#ifdef __linux__
+	if (regular)
+	{
+		watchFd = inotify_init1(IN_CLOEXEC);
+		if (watchFd >= 0) inotify_add_watch(watchFd, file_name.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF);
+	}
+#endif
+}
+
+FollowReader::~FollowReader()
+{
+	// out of StopAll's reach before the pipe goes
+	if (slot >= 0) Readers()[slot].store(0);
+	if (fd >= 0) close(fd);
+	if (watchFd >= 0) close(watchFd);
+	if (stopPipe[0] >= 0) close(stopPipe[0]);
+	if (stopPipe[1] >= 0) close(stopPipe[1]);
+}
+
+size_t FollowReader::Next(char* buf, size_t cap)
+{
+	if (fd < 0) return 0;
+
+	while (true)
+	{
+		if (!regular && !Wait()) return 0;
+
+		ssize_t n = read(fd, buf, cap);
+		if (n > 0) return n;
+		if (n < 0 && errno == EINTR) continue;
+		// error, or the writer closed the pipe
+		if (n < 0 || !regular) return 0;
+
+		// at the end of a regular file: start over if it was truncated
+		struct stat st;
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		if (fstat(fd, &st) == 0 && st.st_size < offset)
+		{
+			lseek(fd, 0, SEEK_SET);
+			continue;
+		}
+		if (finishing || watchFd < 0 || !Wait()) return 0;
+	}
+}
+
+bool FollowReader::Wait()
+{
+	while (true)
+	{
+		pollfd fds[2];
+		fds[0].fd = regular ? watchFd : fd;
+		fds[1].fd = stopPipe[0];
+		for (int i = 0; i < 2; i++)
+		{
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			return false;
+		}
+		// the stop pipe is never drained, so every later Wait of this reader sees it too
+		if (fds[1].revents) return false;
+		if (!fds[0].revents) continue;
+
+#ifdef __linux__
+		if (regular)
+		{
+			char events[4096];
+			ssize_t n = read(watchFd, events, sizeof(events));
+			for (ssize_t i = 0; i + (ssize_t)sizeof(inotify_event) <= n;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(events + i);
+				if (event->mask & (IN_MOVE_SELF | IN_IGNORED)) finishing = true;
+				i += sizeof(inotify_event) + event->len;
+			}
+			// our descriptor keeps a deleted file alive, so look at its link count
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_nlink == 0) finishing = true;
+		}
+#endif
+		return true;
+	}
+}
+
+void FollowReader::Stop()
+{
+	char c = 0;
+	if (stopPipe[1] >= 0 && write(stopPipe[1], &c, 1) < 0) {}
+}
+
+void FollowReader::StopAll()
+{
+	char c = 0;
+	for (int i = 0; i < MAX_READERS; i++)
+	{
+		int stopFd = Readers()[i].load();
+		if (stopFd > 0 && write(stopFd - 1, &c, 1) < 0) {}
+	}
+}
+
+atomic<int>* FollowReader::Readers()
+{
+	static atomic<int> readers[MAX_READERS];
+	return readers;
+}
+
+
+template<typename F>
+long FollowRecords(FollowReader& reader, F fn)
+{
+	CSVTokenizer tokenizer;
+	vector<char> buffer(1 << 16);
+	size_t used = 0;
+	long records = 0;
+
+	while (true)
+	{
+		if (used == buffer.size()) buffer.resize(2 * buffer.size());
+		size_t n = reader.Next(buffer.data() + used, buffer.size() - used);
+		if (n == 0) break;
+		used += n;
+
+		// hand over complete lines only, keep the partial last line for later
+		size_t complete = used;
+		while (complete > 0 && buffer[complete - 1] != '\n') complete--;
+		if (complete == 0) continue;
+
+		size_t count = tokenizer.Tokenize(buffer.data(), complete);
+		for (size_t i = 0; i < count; i++)
+		{
+			fn(tokenizer.GetFields(i), tokenizer.GetFieldCount(i));
+		}
+		records += count;
+		memmove(buffer.data(), buffer.data() + complete, used - complete);
+		used -= complete;
+	}
+
+	// last line without a '\n'
+	size_t count = tokenizer.Tokenize(buffer.data(), used);
+	for (size_t i = 0; i < count; i++)
+	{
+		fn(tokenizer.GetFields(i), tokenizer.GetFieldCount(i));
+	}
+	return records + count;
+}
+
+#endif
@@ -1,21 +1,21 @@
 #ifndef GUISERVICEHPP
-#define GUISERVICEHPP
+#define GUISERVICEHPP
 
 #include "soa.hpp"
-#include "pricingservice.hpp"
-#include <unordered_map>
-#include "tools.h"
-#include <fstream>
+#include "pricingservice.hpp"
+#include "tools.h"
+#include "metrics.h"
+#include <fstream>
 #include <chrono>
 using namespace std::chrono;
 template<typename T>
-class GUIService;
-
+class GUIService;
+
 /**
 * guilistener
 * Keyed on product identifier.
 * Type T is the product type.
-*/
+*/
 template<typename T>
 class GUIListener : public ServiceListener<Price<T>>
 {
@@ -24,6 +24,8 @@ private:
 
 	GUIService<T>* GUIS;
 	long long time;
+	// prices dropped by the throttle
+	Counter& throttled;
 
 
 public:
@@ -50,11 +52,12 @@ template<typename T>
 class GUIService : Service<string, Price<T>> {
 private:
 
-	unordered_map<string, Price<T>> prices;
+	ProductTable<Price<T>> prices;
 	vector<ServiceListener<Price<T>>*> listeners;
 	GUIConnector<T>* connector;
 	ServiceListener<Price<T>>* listener;
 	int throttle;
+	ServiceMetrics metrics;
 
 public:
 
@@ -62,7 +65,7 @@ public:
 	GUIService(int _throttle);
 
 	// Get data on our service given a key
-	Price<T>& GetData(string key);
+	Price<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Price<T>& data);
@@ -99,6 +102,9 @@ private:
 	GUIService<T>* GUIS;
 	//we only print first 100 updates
 	int cnt;
+	ConnectorMetrics metrics;
+	// prices dropped after the first 100
+	Counter& dropped;
 
 public:
 
@@ -114,7 +120,8 @@ public:
 /*    implementation     */
 template<typename T>
 GUIListener<T>::GUIListener(GUIService<T>* _service)
-	:GUIS(_service), time(0){}
+	:GUIS(_service), time(0),
+	throttled(MetricsRegistry::GetCounter("soa_gui_dropped_total", "reason=\"throttle\"", "Prices the GUI did not show")) {}
 
 template<typename T>
 void GUIListener<T>::ProcessAdd(Price<T>& data)
@@ -127,33 +134,36 @@ void GUIListener<T>::ProcessAdd(Price<T>& data)
 		GUIS->OnMessage(data);
 		time = now;
 	}
+	else if (MetricsRegistry::IsEnabled()) throttled.Add();
 }
 
 template<typename T>
 void GUIListener<T>::ProcessRemove(Price<T>& data) {}
 
 template<typename T>
-void GUIListener<T>::ProcessUpdate(Price<T>& data) {}
-
-
-
-
+void GUIListener<T>::ProcessUpdate(Price<T>& data) {}
+
+
+
+
 template<typename T>
 GUIService<T>::GUIService(int _throttle)
 	:throttle(_throttle), listener(new GUIListener<T>(this)), 
-	connector(new GUIConnector<T>(this)){}
+	connector(new GUIConnector<T>(this)), metrics("GUIService") {}
 
 
 template<typename T>
-Price<T>& GUIService<T>::GetData(string key)
+Price<T>& GUIService<T>::GetData(const string& key)
 {
-	return prices[key];
+	return prices[GetProductIndex(key)];
 }
 
 template<typename T>
 void GUIService<T>::OnMessage(Price<T>& data)
 {
-	prices[data.GetProduct().GetTicker()] = data;
+	prices[data.GetProduct().GetIndex()] = data;
+	metrics.In();
+	metrics.SetSize(prices.Size());
 	connector->Publish(data);
 }
 
@@ -190,21 +200,28 @@ int GUIService<T>::GetThrottle() const
 
 template<typename T>
 GUIConnector<T>::GUIConnector(GUIService<T>* _service)
-	:GUIS(_service), cnt(0) {}
+	:GUIS(_service), cnt(0), metrics("GUIConnector"),
+	dropped(MetricsRegistry::GetCounter("soa_gui_dropped_total", "reason=\"limit\"", "Prices the GUI did not show")) {}
 
 
 template<typename T>
 void GUIConnector<T>::Publish(Price<T>& data)
 {
 	//only print first 100 updates
-	if (cnt >= 100) return;
+	if (cnt >= 100)
+	{
+		if (MetricsRegistry::IsEnabled()) dropped.Add();
+		return;
+	}
 
 	ofstream file;
 	file.open("gui.txt", ios_base::app);
 
-	file << getCurrentTimestamp() << "," << data.To_string()<<endl;
+	string line = getCurrentTimestamp() + "," + data.To_string() + "\n";
+	file << line << flush;
 	file.close();
+	metrics.Written(line.size());
 	cnt++;
 }
-
-#endif
+
+#endif
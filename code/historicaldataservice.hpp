@@ -14,6 +14,8 @@
 #include <string>
 #include <fstream>
 #include "tools.h"
+#include "latency.h"
+#include "metrics.h"
 
 template<typename T>
 class HistoricalDataService;
@@ -42,6 +44,9 @@ public:
 	// Listener callback to process an update event to the Service
 	void ProcessUpdate(T& data);
 
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(T* data, size_t n);
+
 
 };
 
@@ -61,12 +66,14 @@ private:
 	HistoricalDataConnector<T>* connector;
 	ServiceListener<T>* listener;
 	string file_name;
+	LatencyHistogram* hop;
+	ServiceMetrics metrics;
 public:
 
 	HistoricalDataService(string file_name);
 
 	// Get data on our service given a key
-	T& GetData(string key);
+	T& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(T& data);
@@ -86,6 +93,9 @@ public:
 	// Persist data to a store
 	void PersistData(string persistKey, T& data);
 
+	// Persist a batch of data to a store in one write
+	void PersistDataBatch(T* data, size_t n);
+
 	string GetFileName();
 };
 
@@ -100,14 +110,18 @@ class HistoricalDataConnector : public Connector<T>
 private:
 
 	HistoricalDataService<T>* HS;
+	ConnectorMetrics metrics;
 
 public:
 
-	HistoricalDataConnector(HistoricalDataService<T>* _service);
+	HistoricalDataConnector(HistoricalDataService<T>* _service, const string& file_name);
 
 	// Publish data to the Connector
 	void Publish(T& _data);
 
+	// Publish a batch of data, opening the file once
+	void PublishBatch(T* data, size_t n);
+
 
 };
 
@@ -130,6 +144,12 @@ void HistoricalDataListener<T>::ProcessAdd(T & data)
 	HS->PersistData(data.GetProduct().GetTicker(), data);
 }
 
+template<typename T>
+void HistoricalDataListener<T>::ProcessAddBatch(T* data, size_t n)
+{
+	HS->PersistDataBatch(data, n);
+}
+
 template<typename T>
 void HistoricalDataListener<T>::ProcessRemove(T& data) {}
 
@@ -140,13 +160,14 @@ void HistoricalDataListener<T>::ProcessUpdate(T& data) {}
 template<typename T>
 HistoricalDataService<T>::HistoricalDataService(string _file)
 	:listener(new HistoricalDataListener<T>(this)),
-	connector(new HistoricalDataConnector<T>(this)),
-	file_name(_file) {}
+	connector(new HistoricalDataConnector<T>(this, _file)),
+	file_name(_file), hop(&LatencyTrace::Hop("HistoricalDataService(" + _file + ")")),
+	metrics("HistoricalDataService(" + _file + ")") {}
 
 
 
 template<typename T>
-T& HistoricalDataService<T>::GetData(string key)
+T& HistoricalDataService<T>::GetData(const string& key)
 {
 	return Datas[key];
 }
@@ -188,7 +209,18 @@ ServiceListener<T>* HistoricalDataService<T>::GetListener()
 template<typename T>
 void HistoricalDataService<T>::PersistData(string _persistKey, T& data)
 {
+	metrics.In();
 	connector->Publish(data);
+	hop->RecordSince(GetIngestTicks(data));
+}
+
+
+template<typename T>
+void HistoricalDataService<T>::PersistDataBatch(T* data, size_t n)
+{
+	metrics.In(n);
+	connector->PublishBatch(data, n);
+	for (size_t i = 0; i < n; i++) hop->RecordSince(GetIngestTicks(data[i]));
 }
 
 
@@ -200,19 +232,40 @@ string HistoricalDataService<T>::GetFileName()
 
 
 template<typename T>
-HistoricalDataConnector<T>::HistoricalDataConnector(HistoricalDataService<T>* _service)
-	:HS(_service) {}
+HistoricalDataConnector<T>::HistoricalDataConnector(HistoricalDataService<T>* _service, const string& file_name)
+	:HS(_service), metrics("HistoricalDataConnector(" + file_name + ")") {}
 
 template<typename T>
 void HistoricalDataConnector<T>::Publish(T& data)
 {
-	std::ofstream outfile;
-	// append instead of overwrite
+	std::ofstream outfile;
+	// append instead of overwrite
+	outfile.open(HS->GetFileName(), ios_base::app);
+
+	string line = getCurrentTimestamp() + ", " + data.To_string() + "\n";
+	outfile << line << flush;
+	outfile.close();
+	metrics.Written(line.size());
+}
+
+
+template<typename T>
+void HistoricalDataConnector<T>::PublishBatch(T* data, size_t n)
+{
+	std::ofstream outfile;
+	// append instead of overwrite
 	outfile.open(HS->GetFileName(), ios_base::app);
 
-	outfile << getCurrentTimestamp()<<", ";
-	outfile << data.To_string() << endl;
+	string timestamp = getCurrentTimestamp();
+	size_t bytes = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		string line = data[i].To_string();
+		outfile << timestamp << ", " << line << '\n';
+		bytes += timestamp.size() + line.size() + 3;
+	}
 	outfile.close();
+	metrics.Written(bytes);
 }
 
 
@@ -12,6 +12,9 @@
 #include <unordered_map>
 #include <fstream>
 #include "tools.h"
+#include "metrics.h"
+#include "csvtokenizer.h"
+#include "followreader.h"
 
 // Various inqyury states
 enum InquiryState { RECEIVED, QUOTED, DONE, REJECTED, CUSTOMER_REJECTED };
@@ -28,7 +31,7 @@ public:
 
   // ctor for an inquiry
 	Inquiry() = default;
-  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
+  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, TickPrice _price, InquiryState _state);
 
   // Get the inquiry ID
   const string& GetInquiryId() const;
@@ -43,23 +46,23 @@ public:
   long GetQuantity() const;
 
   // Get the price that we have responded back with
-  double GetPrice() const;
+  TickPrice GetPrice() const;
 
   // Get the current state on the inquiry
   InquiryState GetState() const;
 
   void setState(InquiryState s);
-  void setPrice(double p);
+  void setPrice(TickPrice p);
 
   //string to print
   string To_string();
 
 private:
   string inquiryId;
-  T product;
+  ProductRef<T> product;
   Side side;
   long quantity;
-  double price;
+  TickPrice price;
   InquiryState state;
 
 };
@@ -79,12 +82,13 @@ private:
 	unordered_map<string, Inquiry<T>> inquiries;
 	vector<ServiceListener<Inquiry<T>>*> listeners;
 	IQConnector<T>* connector;
+	ServiceMetrics metrics;
 
 public:
 	InquiryService();
 
 	// Get data on our service given a key
-	Inquiry<T>& GetData(string key);
+	Inquiry<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Inquiry<T>& data);
@@ -96,7 +100,7 @@ public:
 	const vector<ServiceListener<Inquiry<T>>*>& GetListeners() const;
 
   // Send a quote back to the client
-  void SendQuote(const string &inquiryId, double price) ;
+  void SendQuote(const string &inquiryId, TickPrice price) ;
 
   // Reject an inquiry from the client
   void RejectInquiry(const string &inquiryId);
@@ -113,11 +117,17 @@ class IQConnector : public Connector<Inquiry<T>>
 private:
 
 	InquiryService<T>* IQS;
+	ReadMode mode;
+	IngestStats stats;
+	ConnectorMetrics metrics;
+
+	// Turn one record of inquiries.txt into an Inquiry and send it to the service
+	void ProcessRecord(const FieldRef* blocks, size_t n);
 
 public:
 
 	// Connector and Destructor
-	IQConnector(InquiryService<T>* service);
+	IQConnector(InquiryService<T>* service, ReadMode _mode = STREAM_READ);
 
 	// Publish data to the Connector
 	void Publish(Inquiry<T>& data);
@@ -125,12 +135,21 @@ public:
 	// Re-subscribe data from the Connector
 	void Consume(string file_name);
 
+	// Read records as they are appended to a file or written to a pipe, until the reader ends
+	void Follow(FollowReader& reader);
+
+	// Choose how Consume reads its file
+	void SetReadMode(ReadMode _mode);
+
+	// Line count and ingest rate of the last Consume
+	const IngestStats& GetStats() const;
+
 };
 
 
 /*       implementation   */
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
+Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, TickPrice _price, InquiryState _state) :
   product(_product)
 {
   inquiryId = _inquiryId;
@@ -149,7 +168,7 @@ const string& Inquiry<T>::GetInquiryId() const
 template<typename T>
 const T& Inquiry<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
@@ -165,7 +184,7 @@ long Inquiry<T>::GetQuantity() const
 }
 
 template<typename T>
-double Inquiry<T>::GetPrice() const
+TickPrice Inquiry<T>::GetPrice() const
 {
   return price;
 }
@@ -184,7 +203,7 @@ void Inquiry<T>::setState(InquiryState s)
 
 
 template<typename T>
-void Inquiry<T>::setPrice(double p)
+void Inquiry<T>::setPrice(TickPrice p)
 {
 	price = p;
 }
@@ -221,17 +240,17 @@ string Inquiry<T>::To_string()
 		_state = "CUSTOMER_REJECTED";
 		break;
 	}
-	return product.GetTicker() + ' ' + inquiryId + ' ' + _side + ' ' +
+	return product->GetTicker() + ' ' + inquiryId + ' ' + _side + ' ' +
 		PriceDTS(price) + ' ' + to_string(quantity) + ' ' + _state;
 }
 
 template<typename T>
 InquiryService<T>::InquiryService()
-	:connector(new IQConnector<T>(this)) {}
+	:connector(new IQConnector<T>(this)), metrics("InquiryService") {}
 
 
 template<typename T>
-Inquiry<T>& InquiryService<T>::GetData(string key)
+Inquiry<T>& InquiryService<T>::GetData(const string& key)
 {
 	return inquiries[key];
 }
@@ -242,17 +261,22 @@ void InquiryService<T>::OnMessage(Inquiry<T>& data)
 	InquiryState state = data.GetState();
 
 	inquiries[data.GetInquiryId()] = data;
+	metrics.In();
+	metrics.SetSize(inquiries.size());
 	switch (state)
 	{
 	case RECEIVED:
-		SendQuote(data.GetInquiryId(), 100);
+		SendQuote(data.GetInquiryId(), 100 * TICKS_PER_POINT);
 		break;
 	case QUOTED:
 		data.setState(DONE);
 
-		for (auto l : listeners)
 		{
-			l->ProcessAdd(data);
+			ListenerTimer timer(metrics, listeners.size());
+			for (auto l : listeners)
+			{
+				l->ProcessAdd(data);
+			}
 		}
 
 		break;
@@ -273,7 +297,7 @@ const vector<ServiceListener<Inquiry<T>>*>& InquiryService<T>::GetListeners() co
 
 
 template<typename T>
-void InquiryService<T>::SendQuote(const string& inquiryId, double price)
+void InquiryService<T>::SendQuote(const string& inquiryId, TickPrice price)
 {
 	inquiries[inquiryId].setPrice(price);
 	connector->Publish(inquiries[inquiryId]);
@@ -292,8 +316,8 @@ IQConnector<T>* InquiryService<T>::getConnector()
 }
 
 template<typename T>
-IQConnector<T>::IQConnector(InquiryService<T>* service)
-	:IQS(service) {}
+IQConnector<T>::IQConnector(InquiryService<T>* service, ReadMode _mode)
+	:IQS(service), mode(_mode), metrics("IQConnector") {}
 
 
 template<typename T>
@@ -306,34 +330,54 @@ void IQConnector<T>::Publish(Inquiry<T>& data)
 template<typename T>
 void IQConnector<T>::Consume(string file_name)
 {
-	ifstream file(file_name);
-	string line;
-	while (getline(file, line))
-	{
-		stringstream linestream(line); string block;
-		vector<string> blocks;
-		while (getline(linestream, block, ','))
-		{
-            if ((block[block.size()-1] == '\r') || (block[block.size()-1] == '\n')){
-                block.erase(block.size()-1);
-            }
-			blocks.push_back(block);
-		}
-		Side s = BUY;
-		if (blocks[2] == "Sell") s = SELL;
-
-		InquiryState _state;
-		if (blocks[5] == "RECEIVED") _state = RECEIVED;
-		else if (blocks[5] == "QUOTED") _state = QUOTED;
-		else if (blocks[5] == "DONE") _state = DONE;
-		else if (blocks[5] == "REJECTED") _state = REJECTED;
-		else if (blocks[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
-
-		Inquiry<T> _inquiry(blocks[1], GetBond(blocks[0]), s,
-			stol(blocks[4]), PriceSTD(blocks[3]), _state);
-		IQS->OnMessage(_inquiry);
-	}
+	stats.Start();
+	long lines = ForEachRecord(file_name, mode, [this](const FieldRef* blocks, size_t n) {
+		ProcessRecord(blocks, n);
+	});
+	stats.Stop(lines);
+}
 
+template<typename T>
+void IQConnector<T>::Follow(FollowReader& reader)
+{
+	stats.Start();
+	long lines = FollowRecords(reader, [this](const FieldRef* blocks, size_t n) {
+		ProcessRecord(blocks, n);
+	});
+	stats.Stop(lines);
+}
+
+template<typename T>
+void IQConnector<T>::ProcessRecord(const FieldRef* blocks, size_t n)
+{
+	if (n < 6) return;
+
+	Side s = BUY;
+	if (blocks[2] == "Sell") s = SELL;
+
+	InquiryState _state = RECEIVED;
+	if (blocks[5] == "RECEIVED") _state = RECEIVED;
+	else if (blocks[5] == "QUOTED") _state = QUOTED;
+	else if (blocks[5] == "DONE") _state = DONE;
+	else if (blocks[5] == "REJECTED") _state = REJECTED;
+	else if (blocks[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
+
+	Inquiry<T> _inquiry(blocks[1].ToString(), GetBond(GetProductIndex(blocks[0].Begin(), blocks[0].End())), s,
+		stol(blocks[4].ToString()), PriceSTD(blocks[3].Begin(), blocks[3].End()), _state);
+	metrics.Read();
+	IQS->OnMessage(_inquiry);
+}
+
+template<typename T>
+void IQConnector<T>::SetReadMode(ReadMode _mode)
+{
+	mode = _mode;
+}
+
+template<typename T>
+const IngestStats& IQConnector<T>::GetStats() const
+{
+	return stats;
 }
 
 
@@ -0,0 +1,277 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <ostream>
+#include <iomanip>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// Read the time stamp counter, or the steady clock in nanoseconds where there is none.
+// The counter is assumed to tick at the same constant rate on every core.
+inline uint64_t ReadTSC()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Get the nanoseconds per tick of ReadTSC, measured against the steady clock on the first call
+double TSCNanos();
+
+/**
+* Histogram of latencies in TSC ticks, HDR style.
+* Values below 64 get a bucket each; above, every power of two is split into
+* 32 buckets, so a value is known within about 3% up to 2^64. Recording is a
+* relaxed atomic increment and any thread may record or read at any time.
+*/
+class LatencyHistogram
+{
+
+public:
+
+	LatencyHistogram(const string& _name);
+
+	// Record a latency in ticks
+	void Record(uint64_t ticks);
+
+	// Record the time since an ingest stamp. Messages stamped 0 are not traced.
+	void RecordSince(uint64_t ingestTicks);
+
+	const string& GetName() const;
+
+	uint64_t GetCount() const;
+
+	// Get the latency at a quantile in [0, 1], in nanoseconds
+	double GetPercentile(double quantile) const;
+
+	// Get the largest latency, in nanoseconds
+	double GetMax() const;
+
+private:
+	static const int SUB_BUCKETS = 64;
+	static const int HALF_BUCKETS = SUB_BUCKETS / 2;
+	static const int BUCKET_COUNT = (64 - 6) * HALF_BUCKETS + SUB_BUCKETS;
+
+	static int BucketOf(uint64_t ticks);
+	// Get the largest value of a bucket
+	static uint64_t BucketTop(int bucket);
+
+	string name;
+	atomic<uint64_t> counts[BUCKET_COUNT];
+	atomic<uint64_t> count;
+	atomic<uint64_t> max;
+
+};
+
+/**
+* Latency tracing of messages from their ingest stamp.
+* Connectors stamp messages with Stamp() when they read them, and each service
+* records the time since the stamp into its hop's histogram when it hands the
+* message on. Tracing is off until Enable(); the stamp is then 0 and nothing
+* is recorded.
+*/
+class LatencyTrace
+{
+
+public:
+
+	static void Enable(bool enabled = true);
+
+	static bool IsEnabled();
+
+	// Get an ingest stamp for a message read now, 0 when tracing is off
+	static uint64_t Stamp();
+
+	// Get the histogram of a hop, created on first use. Hops are listed in creation order.
+	static LatencyHistogram& Hop(const string& name);
+
+	// Write p50/p99/p99.9/max of every hop that recorded something.
+	// Can be called at any time, the hops keep recording.
+	static void Dump(ostream& out);
+
+private:
+	static atomic<bool>& Enabled();
+	static mutex& HopsMutex();
+	static deque<unique_ptr<LatencyHistogram>>& Hops();
+
+};
+
+// Get the ingest stamp of a message. Messages without one report 0.
+template<typename V>
+uint64_t GetIngestTicks(const V& data);
+
+
+
+
+/*    implementation     */
+double TSCNanos()
+{
+	static double nanos = []() {
+		auto start = chrono::steady_clock::now();
+		uint64_t ticks = ReadTSC();
+		this_thread::sleep_for(chrono::milliseconds(20));
+		double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		return elapsed / (ReadTSC() - ticks);
+	}();
+	return nanos;
+}
+
+
+LatencyHistogram::LatencyHistogram(const string& _name)
+	:name(_name), count(0), max(0)
+{
+	for (auto& c : counts) c.store(0, memory_order_relaxed);
+}
+
+void LatencyHistogram::Record(uint64_t ticks)
+{
+	counts[BucketOf(ticks)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	uint64_t top = max.load(memory_order_relaxed);
+	while (ticks > top && !max.compare_exchange_weak(top, ticks, memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::RecordSince(uint64_t ingestTicks)
+{
+	if (ingestTicks == 0) return;
+	Record(ReadTSC() - ingestTicks);
+}
+
+const string& LatencyHistogram::GetName() const
+{
+	return name;
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+	return count.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::GetPercentile(double quantile) const
+{
+	// counts may move while we read, so the total is taken from the buckets themselves
+	uint64_t total = 0;
+	for (auto& c : counts) total += c.load(memory_order_relaxed);
+	if (total == 0) return 0;
+	uint64_t rank = (uint64_t)(quantile * total);
+	if (rank >= total) rank = total - 1;
+	uint64_t seen = 0;
+	for (int b = 0; b < BUCKET_COUNT; b++)
+	{
+		seen += counts[b].load(memory_order_relaxed);
+		if (seen > rank) return min(BucketTop(b), max.load(memory_order_relaxed)) * TSCNanos();
+	}
+	return GetMax();
+}
+
+double LatencyHistogram::GetMax() const
+{
+	return max.load(memory_order_relaxed) * TSCNanos();
+}
+
+int LatencyHistogram::BucketOf(uint64_t ticks)
+{
+	if (ticks < (uint64_t)SUB_BUCKETS) return (int)ticks;
+	int msb = 63;
+	while (!(ticks >> msb)) msb--;
+	// the top 6 bits of the value, the leading one included, pick the bucket
+	int shift = msb - 5;
+	return shift * HALF_BUCKETS + (int)(ticks >> shift);
+}
+
+uint64_t LatencyHistogram::BucketTop(int bucket)
+{
+	if (bucket < SUB_BUCKETS) return bucket;
+	int shift = bucket / HALF_BUCKETS - 1;
+	uint64_t mantissa = bucket - shift * HALF_BUCKETS;
+	return ((mantissa + 1) << shift) - 1;
+}
+
+
+void LatencyTrace::Enable(bool enabled)
+{
+	Enabled().store(enabled, memory_order_relaxed);
+}
+
+bool LatencyTrace::IsEnabled()
+{
+	return Enabled().load(memory_order_relaxed);
+}
+
+uint64_t LatencyTrace::Stamp()
+{
+	return IsEnabled() ? ReadTSC() : 0;
+}
+
+LatencyHistogram& LatencyTrace::Hop(const string& name)
+{
+	lock_guard<mutex> lock(HopsMutex());
+	for (auto& hop : Hops())
+	{
+		if (hop->GetName() == name) return *hop;
+	}
+	Hops().push_back(unique_ptr<LatencyHistogram>(new LatencyHistogram(name)));
+	return *Hops().back();
+}
+
+void LatencyTrace::Dump(ostream& out)
+{
+	lock_guard<mutex> lock(HopsMutex());
+	ios_base::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << "latency since ingest, ns" << endl;
+	for (auto& hop : Hops())
+	{
+		if (hop->GetCount() == 0) continue;
+		out << "    " << left << setw(40) << hop->GetName() << right << fixed << setprecision(0)
+			<< " count " << hop->GetCount()
+			<< " p50 " << hop->GetPercentile(0.5)
+			<< " p99 " << hop->GetPercentile(0.99)
+			<< " p99.9 " << hop->GetPercentile(0.999)
+			<< " max " << hop->GetMax() << endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+atomic<bool>& LatencyTrace::Enabled()
+{
+	static atomic<bool> enabled(false);
+	return enabled;
+}
+
+mutex& LatencyTrace::HopsMutex()
+{
+	static mutex hopsMutex;
+	return hopsMutex;
+}
+
+deque<unique_ptr<LatencyHistogram>>& LatencyTrace::Hops()
+{
+	static deque<unique_ptr<LatencyHistogram>> hops;
+	return hops;
+}
+
+
+template<typename V>
+uint64_t GetIngestTicks(const V& data)
+{
+	return 0;
+}
+
+#endif
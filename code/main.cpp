@@ -1,86 +1,255 @@
-
-
-
-#include <iostream>
-
-#include "products.hpp"
-#include "pricingservice.hpp"
-#include "algostreamingservice.h"
-#include "streamingservice.hpp"
-#include "historicaldataservice.hpp"
-#include "guiservice.h"
-#include "tradebookingservice.hpp"
-#include "positionservice.hpp"
-#include "riskservice.hpp"
-#include "marketdataservice.hpp"
-#include "algoexecutionservice.h"
-#include "executionservice.hpp"
-#include "inquiryservice.hpp"
-
-
-
-int main() {
-    
-	//prices.txt
-	
-	PricingService<Bond> PS;
-	AlgoStreamingService<Bond> ASS;
-	StreamingService<Bond> SS;
-	HistoricalDataService<PriceStream<Bond>> HDSPS("streaming.txt");
-	GUIService<Bond> GUIS(300);
-	
-	PS.AddListener(ASS.GetListener());
-	ASS.AddListener(SS.GetListener());
-	SS.AddListener(HDSPS.GetListener());
-	PS.AddListener(GUIS.GetListener());
-	PSConnector<Bond> psc(&PS);
-    cout<<"processing prices.txt"<<endl;
-	psc.Consume("prices.txt");
-	
-
-
-	//trades.txt
-	TradeBookingService<Bond> TBS;
-	PositionService<Bond> POSS;
-	HistoricalDataService<Position<Bond>> HDSPOS("positions.txt");
-	RiskService<Bond> RS;
-	HistoricalDataService<PV01<Bond>> HDSRISK("risk.txt");
-
-	TBS.AddListener(POSS.GetListener());
-	POSS.AddListener(HDSPOS.GetListener());
-	POSS.AddListener(RS.GetListener());
-	RS.AddListener(HDSRISK.GetListener());
-
-	TBSConnector<Bond> tbsc(&TBS);
-    cout<<"processing trades.txt"<<endl;
-	tbsc.Consume("trades.txt");
-	
-
-	//marketdata.txt
-	MarketDataService<Bond> MDS;
-	AlgoExecutionService<Bond> AES;
-	ExecutionService<Bond> ES;
-	HistoricalDataService<ExecutionOrder<Bond>> HDSE("executions.txt");
-
-	MDS.AddListener(AES.GetListener());
-	AES.AddListener(ES.GetListener());
-	ES.AddListener(HDSE.GetListener());
-	ES.AddListener(TBS.GetListener());
-	
-
-	MDConnector<Bond> mdc(&MDS);
-    cout<<"processing marketdata.txt"<<endl;
-	mdc.Consume("marketdata.txt");
-	
-
-	//inquiry.txt
-	InquiryService<Bond> IQS;
-	HistoricalDataService<Inquiry<Bond>> HDSIQ("allinquiries.txt");
-	IQS.AddListener(HDSIQ.GetListener());
-    cout<<"processing inquiries.txt"<<endl;
-	IQS.getConnector()->Consume("inquiries.txt");
-
-
-	return 0;
-
-}
+
+
+
+#include <iostream>
+#include <csignal>
+#include <memory>
+
+#include "products.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.h"
+#include "streamingservice.hpp"
+#include "historicaldataservice.hpp"
+#include "guiservice.h"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.h"
+#include "executionservice.hpp"
+#include "inquiryservice.hpp"
+#include "taskgraph.h"
+#include "shardedmarketdata.h"
+#include "conflatinglistener.h"
+#include "bookhistory.h"
+
+
+
+int main(int argc, char* argv[]) {
+
+	// "./a.out stream" reads the input files line by line with getline, for comparison
+	// "./a.out binary" reads market data from marketdata.bin (see mdconvert.cpp)
+	// "./a.out follow" keeps reading the four input files (or named pipes) at once as they
+	// are written, until their writers close them or Ctrl-C
+	// "./a.out async" writes streaming.txt and feeds the GUI on their own threads
+	// "./a.out parallel" runs the four flows at once (see the task graph below)
+	// "./a.out sharded" runs market data through executions on a worker thread per shard of tickers
+	// "./a.out metrics [target]" counts messages, listener time, entries and bytes per service and
+	// connector, exported every second to metrics.prom or the target (see metrics.h), e.g. http:9100
+	// "./a.out trace" stamps prices as they are read and reports the latency at each service
+	// "./a.out conflate" sends the GUI the newest price of each ticker every 300ms instead of throttling it
+	// "./a.out history" keeps the last 1000 books of each ticker in memory and reports on them
+	ReadMode readMode = MAPPED_READ;
+	bool binaryMarketData = false;
+	bool follow = false;
+	bool async = false;
+	bool parallel = false;
+	bool sharded = false;
+	bool conflate = false;
+	bool history = false;
+	if (argc > 1 && string(argv[1]) == "stream") readMode = STREAM_READ;
+	if (argc > 1 && string(argv[1]) == "binary") binaryMarketData = true;
+	if (argc > 1 && string(argv[1]) == "follow") follow = true;
+	if (argc > 1 && string(argv[1]) == "async") async = true;
+	if (argc > 1 && string(argv[1]) == "parallel") parallel = true;
+	if (argc > 1 && string(argv[1]) == "sharded") sharded = true;
+	if (argc > 1 && string(argv[1]) == "conflate") conflate = true;
+	if (argc > 1 && string(argv[1]) == "history") history = true;
+	if (argc > 1 && string(argv[1]) == "trace") LatencyTrace::Enable();
+	unique_ptr<MetricsExporter> metricsExporter;
+	if (argc > 1 && string(argv[1]) == "metrics")
+	{
+		MetricsRegistry::Enable();
+		metricsExporter.reset(new MetricsExporter(argc > 2 ? argv[2] : "metrics.prom"));
+	}
+	// in follow mode each input has its own reader, all made before Ctrl-C can stop them
+	unique_ptr<FollowReader> pricesReader, tradesReader, marketDataReader, inquiriesReader;
+	if (follow)
+	{
+		pricesReader.reset(new FollowReader("prices.txt"));
+		tradesReader.reset(new FollowReader("trades.txt"));
+		marketDataReader.reset(new FollowReader("marketdata.txt"));
+		inquiriesReader.reset(new FollowReader("inquiries.txt"));
+		signal(SIGINT, [](int) { FollowReader::StopAll(); });
+	}
+
+	//prices.txt
+	
+	PricingService<Bond> PS;
+	AlgoStreamingService<Bond> ASS;
+	StreamingService<Bond> SS;
+	HistoricalDataService<PriceStream<Bond>> HDSPS("streaming.txt");
+	GUIService<Bond> GUIS(conflate ? 0 : 300);
+	
+	unique_ptr<AsyncListener<PriceStream<Bond>>> asyncHDSPS;
+	unique_ptr<AsyncListener<Price<Bond>>> asyncGUIS;
+	unique_ptr<ConflatingListener<Price<Bond>>> conflatingGUIS;
+	
+	PS.AddListener(ASS.GetListener());
+	ASS.AddListener(SS.GetListener());
+	if (async)
+	{
+		asyncHDSPS.reset(new AsyncListener<PriceStream<Bond>>(HDSPS.GetListener()));
+		asyncGUIS.reset(new AsyncListener<Price<Bond>>(GUIS.GetListener()));
+		SS.AddListener(asyncHDSPS.get());
+		PS.AddListener(asyncGUIS.get());
+	}
+	else if (conflate)
+	{
+		SS.AddListener(HDSPS.GetListener());
+		conflatingGUIS.reset(new ConflatingListener<Price<Bond>>(GUIS.GetListener(), 300));
+		PS.AddListener(conflatingGUIS.get());
+	}
+	else
+	{
+		SS.AddListener(HDSPS.GetListener());
+		PS.AddListener(GUIS.GetListener());
+	}
+	PSConnector<Bond> psc(&PS, readMode);
+	auto pricesFlow = [&]() {
+    cout<<"processing prices.txt\n";
+	if (follow) psc.Follow(*pricesReader);
+	else psc.Consume("prices.txt");
+	if (async)
+	{
+		asyncHDSPS->Flush();
+		asyncGUIS->Flush();
+	}
+	if (conflate) conflatingGUIS->Drain();
+    cout<<"prices.txt: " + psc.GetStats().To_string() + "\n";
+	};
+	
+
+
+	//trades.txt
+	TradeBookingService<Bond> TBS;
+	PositionService<Bond> POSS;
+	HistoricalDataService<Position<Bond>> HDSPOS("positions.txt");
+	RiskService<Bond> RS;
+	HistoricalDataService<PV01<Bond>> HDSRISK("risk.txt");
+
+	TBS.AddListener(POSS.GetListener());
+	POSS.AddListener(HDSPOS.GetListener());
+	POSS.AddListener(RS.GetListener());
+	RS.AddListener(HDSRISK.GetListener());
+
+	TBSConnector<Bond> tbsc(&TBS, readMode);
+	auto tradesFlow = [&]() {
+    cout<<"processing trades.txt\n";
+	if (follow) tbsc.Follow(*tradesReader);
+	else tbsc.Consume("trades.txt");
+    cout<<"trades.txt: " + tbsc.GetStats().To_string() + "\n";
+	};
+	
+
+	//marketdata.txt
+	MarketDataService<Bond> MDS;
+	AlgoExecutionService<Bond> AES;
+	ExecutionService<Bond> ES;
+	HistoricalDataService<ExecutionOrder<Bond>> HDSE("executions.txt");
+
+	unique_ptr<ShardedMarketDataService<Bond>> shardedMDS;
+	BookHistory<OrderBook<Bond>> bookHistory(1000);
+
+	if (sharded)
+	{
+		// every shard has its own MDS, AES and ES, their executions are merged onto one thread
+		shardedMDS.reset(new ShardedMarketDataService<Bond>(thread::hardware_concurrency()));
+		shardedMDS->AddExecutionListener(HDSE.GetListener());
+		shardedMDS->AddExecutionListener(TBS.GetListener());
+	}
+	else
+	{
+		MDS.AddListener(AES.GetListener());
+		AES.AddListener(ES.GetListener());
+		ES.AddListener(HDSE.GetListener());
+		ES.AddListener(TBS.GetListener());
+	}
+	if (history)
+	{
+		if (sharded) shardedMDS->AddListener(&bookHistory);
+		else MDS.AddListener(&bookHistory);
+	}
+	
+
+	MDConnector<Bond> mdc(sharded ? shardedMDS.get() : &MDS, readMode, thread::hardware_concurrency());
+	auto marketDataFlow = [&]() {
+	if (binaryMarketData)
+	{
+    cout<<"processing marketdata.bin\n";
+	if (mdc.ConsumeBinary("marketdata.bin")) cout<<"marketdata.bin: " + mdc.GetStats().To_string() + "\n";
+	else cout<<"marketdata.bin: missing or not a binary market data file (see mdconvert.cpp)\n";
+	}
+	else
+	{
+    cout<<"processing marketdata.txt\n";
+	if (follow) mdc.Follow(*marketDataReader);
+	else mdc.Consume("marketdata.txt");
+    cout<<"marketdata.txt: " + mdc.GetStats().To_string() + "\n";
+	}
+	// level events on top of the books, when datagen was asked for them
+	if (!follow && ifstream("marketupdates.txt"))
+	{
+    cout<<"processing marketupdates.txt\n";
+	mdc.ConsumeUpdates("marketupdates.txt");
+    cout<<"marketupdates.txt: " + mdc.GetStats().To_string() + "\n";
+	}
+	if (sharded) shardedMDS->Flush();
+	if (history)
+	{
+		// e.g. the best bid/offer of each ticker halfway through the books kept
+		for (int i = 0; i < PRODUCT_COUNT; i++)
+		{
+			if (bookHistory.Size(i) == 0) continue;
+			uint64_t first = bookHistory.GetFirstTime(i);
+			uint64_t last = bookHistory.GetLastTime(i);
+			const BidOffer& bidOffer = bookHistory.AsOf(i, first + (last - first) / 2)->GetBestBidOffer();
+			cout << PRODUCT_TICKERS[i] << ": " << bookHistory.Size(i) << " books over " << (last - first) / 1000 << " us, halfway "
+				<< PriceDTS(bidOffer.GetBidOrder().GetPrice()) << " / " << PriceDTS(bidOffer.GetOfferOrder().GetPrice()) << "\n";
+		}
+	}
+	};
+	
+
+	//inquiry.txt
+	InquiryService<Bond> IQS;
+	HistoricalDataService<Inquiry<Bond>> HDSIQ("allinquiries.txt");
+	IQS.AddListener(HDSIQ.GetListener());
+	IQS.getConnector()->SetReadMode(readMode);
+	auto inquiriesFlow = [&]() {
+    cout<<"processing inquiries.txt\n";
+	if (follow) IQS.getConnector()->Follow(*inquiriesReader);
+	else IQS.getConnector()->Consume("inquiries.txt");
+    cout<<"inquiries.txt: " + IQS.getConnector()->GetStats().To_string() + "\n";
+	};
+
+
+	// Prices and inquiries share no service with the other flows. Trades and market
+	// data only meet at TradeBookingService, which books one trade at a time, so in
+	// parallel mode every flow starts at once, and so in follow mode, where a flow only
+	// ends with its input. Otherwise each flow waits for the one before.
+	bool concurrent = parallel || follow;
+	TaskGraph flows;
+	int prices = flows.AddTask("prices", pricesFlow);
+	int trades = flows.AddTask("trades", tradesFlow, concurrent ? vector<int>() : vector<int>{ prices });
+	int marketData = flows.AddTask("marketdata", marketDataFlow, concurrent ? vector<int>() : vector<int>{ trades });
+	flows.AddTask("inquiries", inquiriesFlow, concurrent ? vector<int>() : vector<int>{ marketData });
+	flows.Run();
+	if (parallel)
+	{
+		for (int i = 0; i < flows.GetTaskCount(); i++)
+		{
+			cout << flows.GetName(i) << " flow: " << flows.GetSeconds(i) << " s" << endl;
+		}
+		cout << "all flows: " << flows.GetSeconds() << " s" << endl;
+	}
+	if (LatencyTrace::IsEnabled())
+	{
+		LatencyTrace::Dump(cout);
+		ofstream latency("latency.txt");
+		LatencyTrace::Dump(latency);
+	}
+
+	return 0;
+
+}
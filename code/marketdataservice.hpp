@@ -9,16 +9,33 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <fstream>
 #include "soa.hpp"
+#include "tools.h"
+#include "csvtokenizer.h"
+#include "followreader.h"
+#include "binarymarketdata.h"
+#include "metrics.h"
 #include <sstream>
+#include <deque>
+#include <future>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 
+// Levels a side of an OrderBook holds inline. With 0 the sides are vectors of any depth;
+// build with e.g. -DORDER_BOOK_DEPTH=8 for books that never allocate.
+#ifndef ORDER_BOOK_DEPTH
+#define ORDER_BOOK_DEPTH 0
+#endif
+
 // Side for market data
 enum PricingSide { BID, OFFER };
 
+// Action of an incremental market data event on a price level
+enum LevelAction { LEVEL_ADD, LEVEL_MODIFY, LEVEL_DELETE };
+
 /**
  * A market data order with price, quantity, and side.
  */
@@ -29,10 +46,10 @@ public:
 
   // ctor for an order
 	Order() = default;
-  Order(double _price, long _quantity, PricingSide _side);
+  Order(TickPrice _price, long _quantity, PricingSide _side);
 
   // Get the price on the order
-  double GetPrice() const;
+  TickPrice GetPrice() const;
 
   // Get the quantity on the order
   long GetQuantity() const;
@@ -41,7 +58,7 @@ public:
   PricingSide GetSide() const;
 
 private:
-  double price;
+  TickPrice price;
   long quantity;
   PricingSide side;
 
@@ -71,10 +88,158 @@ private:
 };
 
 /**
- * Order book with a bid and offer stack.
+ * The price level of an order book changed by the last level event applied to it.
+ * Level is the position of the level in the stack of its side, where it was for a
+ * delete, and -1 when the book was last replaced as a whole. Level events add
+ * levels in price order, so on a side kept best first, as snapshots are, it is
+ * the rank of the level.
+ */
+struct LevelChange
+{
+  PricingSide side;
+  LevelAction action;
+  int level;
+};
+
+/**
+ * Incremental market data event: a price level added, modified or deleted
+ * on one side of the order book of a product.
  * Type T is the product type.
  */
 template<typename T>
+class LevelUpdate
+{
+
+public:
+
+  // ctor for a level event
+  LevelUpdate() = default;
+  LevelUpdate(const T &_product, PricingSide _side, LevelAction _action, TickPrice _price, long _quantity);
+
+  // Get the product
+  const T& GetProduct() const;
+
+  // Get the side of the level
+  PricingSide GetSide() const;
+
+  // Get the action on the level
+  LevelAction GetAction() const;
+
+  // Get the price of the level
+  TickPrice GetPrice() const;
+
+  // Get the new quantity of the level, unused for a delete
+  long GetQuantity() const;
+
+private:
+  ProductRef<T> product;
+  PricingSide side;
+  LevelAction action;
+  TickPrice price;
+  long quantity;
+
+};
+
+/**
+ * One side of an order book: the price and the quantity of each level, in
+ * two arrays. Up to Depth levels are held inline, so building, copying and
+ * scanning a side never allocates and touches a cache line or two.
+ * BookSide<0> keeps its levels in vectors instead, with no limit.
+ */
+template<int Depth>
+class BookSide
+{
+
+public:
+
+  // ctor for a side without levels
+  BookSide();
+
+  // Get the number of levels
+  int Size() const;
+
+  bool Empty() const;
+
+  // Get the price of a level
+  TickPrice GetPrice(int level) const;
+
+  // Get the quantity of a level
+  long GetQuantity(int level) const;
+
+  // Get the level of a price, -1 if the side does not have it
+  int Find(TickPrice price) const;
+
+  // Add a level at the end. False if the side is full.
+  bool Push(TickPrice price, long quantity);
+
+  // Add a level before a level, the ones from it on move down. False if the side is full.
+  bool Insert(int level, TickPrice price, long quantity);
+
+  // Set the quantity of a level
+  void SetQuantity(int level, long quantity);
+
+  // Remove a level, the ones after it move up
+  void Erase(int level);
+
+private:
+  TickPrice prices[Depth];
+  long quantities[Depth];
+  int size;
+
+};
+
+/**
+ * One side of an order book of any depth, the levels in vectors.
+ */
+template<>
+class BookSide<0>
+{
+
+public:
+
+  // ctor for a side without levels
+  BookSide() = default;
+
+  // Get the number of levels
+  int Size() const;
+
+  bool Empty() const;
+
+  // Get the price of a level
+  TickPrice GetPrice(int level) const;
+
+  // Get the quantity of a level
+  long GetQuantity(int level) const;
+
+  // Get the level of a price, -1 if the side does not have it
+  int Find(TickPrice price) const;
+
+  // Add a level at the end
+  bool Push(TickPrice price, long quantity);
+
+  // Add a level before a level, the ones from it on move down
+  bool Insert(int level, TickPrice price, long quantity);
+
+  // Set the quantity of a level
+  void SetQuantity(int level, long quantity);
+
+  // Remove a level, the ones after it move up
+  void Erase(int level);
+
+private:
+  vector<TickPrice> prices;
+  vector<long> quantities;
+
+};
+
+/**
+ * Order book with a bid and offer stack.
+ * The best bid and offer are kept as the book changes, so reading them is a
+ * plain member access.
+ * Type T is the product type. Depth is the number of levels a side holds inline,
+ * levels past it are dropped; with 0 the stacks are vectors of any depth.
+ */
+template<typename T, int Depth = ORDER_BOOK_DEPTH>
 class OrderBook
 {
 
@@ -84,21 +249,49 @@ public:
 	OrderBook() = default;
   OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack);
 
+  // ctor for a book without levels, to be filled with AddLevel
+  OrderBook(const T &_product);
+
   // Get the product
   const T& GetProduct() const;
 
   // Get the bid stack
-  const vector<Order>& GetBidStack() const;
+  const BookSide<Depth>& GetBidStack() const;
 
   // Get the offer stack
-  const vector<Order>& GetOfferStack() const;
+  const BookSide<Depth>& GetOfferStack() const;
+
+  // Add a level at the end of the stack of a side. False if the side is full.
+  bool AddLevel(PricingSide side, TickPrice price, long quantity);
 
+  // Get the best bid/offer order. An empty side gives an order of price and quantity 0.
+  // The reference stays valid, and current, for the life of the book.
   const BidOffer& GetBestBidOffer() const;
 
+  // Apply a level event in place. An add or modify of a price sets the quantity of its
+  // level, adding the level before the first worse price of the side if it does not have it.
+  // On a full side the worst level makes room for it.
+  // False for a delete of a price the side does not have, or an add past the last level of
+  // a full side. Level events expect each side to hold unique prices, best first, as the
+  // books they build do; on a book with repeated prices (see AggregateDepth) they only
+  // change the first level of a price.
+  bool ApplyLevel(PricingSide side, LevelAction action, TickPrice price, long quantity);
+
+  // Get the level changed by the last ApplyLevel
+  const LevelChange& GetLastChange() const;
+
 private:
-  T product;
-  vector<Order> bidStack;
-  vector<Order> offerStack;
+  // Make an order the best of its side
+  void SetBest(const Order& order);
+
+  // Find the best order of a side again
+  void ScanBest(PricingSide side);
+
+  ProductRef<T> product;
+  BookSide<Depth> bidStack;
+  BookSide<Depth> offerStack;
+  BidOffer bestBidOffer = BidOffer(Order(0, 0, BID), Order(0, 0, OFFER));
+  LevelChange lastChange = { BID, LEVEL_ADD, -1 };
 
 };
 
@@ -114,30 +307,59 @@ class MarketDataService : public Service<string,OrderBook <T> >
 {
 private:
 
-	unordered_map<string, OrderBook<T>> orderBooks;
+	// Aggregated book of a ticker, stale once its book changes
+	struct Aggregate
+	{
+		OrderBook<T> orderBook;
+		bool stale = true;
+	};
+
+	// Sort the orders of a side best first into levels, adding up the quantities
+	// of each price, and keep the best bookDepth levels
+	void AggregateSide(const BookSide<ORDER_BOOK_DEPTH>& stack, PricingSide side, vector<Order>& levels) const;
+
+	ProductTable<OrderBook<T>> orderBooks;
 	vector<ServiceListener<OrderBook<T>>*> listeners;
 	int bookDepth;
+	ProductTable<Aggregate> aggregates;
+	vector<Order> bidLevels;
+	vector<Order> offerLevels;
+	ServiceMetrics metrics;
 public:
 
-	MarketDataService();
+	// AggregateDepth keeps the best _bookDepth price levels a side
+	MarketDataService(int _bookDepth = 5);
 
 	// Get data on our service given a key
-	OrderBook<T>& GetData(string _key);
+	OrderBook<T>& GetData(const string& _key);
+	virtual OrderBook<T>& GetData(int productIndex);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(OrderBook<T>& _data);
 
+	// Store a batch of books, then hand the whole batch to each listener
+	void OnMessageBatch(OrderBook<T>* _data, size_t n);
+
+	// Apply a level event in place to the book of its ticker, then hand each listener
+	// that book as an update; its GetLastChange() tells the level that changed.
+	// A one level change does not copy the book. See OrderBook::ApplyLevel for the
+	// books level events expect.
+	virtual void OnLevelUpdate(LevelUpdate<T>& _update);
+
 	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
 	void AddListener(ServiceListener<OrderBook<T>>* _listener);
 
 	// Get all listeners on the Service
 	const vector<ServiceListener<OrderBook<T>>*>& GetListeners() const;
 
-  // Get the best bid/offer order
-  const BidOffer& GetBestBidOffer(const string &ticker);
+  // Get the best bid/offer order, kept by the book of the ticker
+  virtual const BidOffer& GetBestBidOffer(const string &ticker);
+
+  // Aggregate the order book: one level per price, best first, at most bookDepth a side.
+  // The result is kept until the book of the ticker changes.
+  virtual const OrderBook<T>& AggregateDepth(const string &ticker);
 
-  // Aggregate the order book
-  const OrderBook<T>& AggregateDepth(const string &ticker);
+	int GetBookDepth() const;
 
 };
 
@@ -154,11 +376,28 @@ class MDConnector : public Connector<OrderBook<T>>
 private:
 
 	MarketDataService<T>* MDS;
+	ReadMode mode;
+	int threads;
+	IngestStats stats;
+	ConnectorMetrics metrics;
+
+	long ConsumeParallel(const string& file_name);
+
+	// Turn one record of marketdata.txt into an order book. False if the record is too short.
+	// Levels of size 0 are empty and left out, as in binary records.
+	static bool ParseRecord(const FieldRef* blocks, size_t n, OrderBook<T>& orderBook);
+
+	// Parse the records of one chunk of the mapped file into order books
+	static void ParseChunk(FieldRef chunk, vector<OrderBook<T>>* books);
+
+	// Turn one record of marketupdates.txt into a level event. False if the record is not one.
+	static bool ParseUpdate(const FieldRef* blocks, size_t n, LevelUpdate<T>& update);
 
 public:
 
 	// Connector and Destructor
-	MDConnector(MarketDataService<T>* service);
+	// In MAPPED_READ mode the file is parsed on _threads worker threads.
+	MDConnector(MarketDataService<T>* service, ReadMode _mode = STREAM_READ, int _threads = 1);
 
 	// Publish data to the Connector
 	void Publish(OrderBook<T>& data);
@@ -166,18 +405,32 @@ public:
 	// Subscribe data from the Connector
 	void Consume(string file_name);
 
+	// Subscribe data from a binary market data file (see binarymarketdata.h).
+	// False if the file is missing or not in that format.
+	bool ConsumeBinary(string file_name);
+
+	// Subscribe level events from a file of ticker,BID|OFFER,ADD|MODIFY|DELETE,price,quantity lines
+	void ConsumeUpdates(string file_name);
+
+	// Read records as they are appended to a file or written to a pipe, until the reader ends
+	void Follow(FollowReader& reader);
+
+	// Line count and ingest rate of the last Consume
+	const IngestStats& GetStats() const;
+
 };
 
 
+
 /*      implementation      */
-Order::Order(double _price, long _quantity, PricingSide _side)
+Order::Order(TickPrice _price, long _quantity, PricingSide _side)
 {
   price = _price;
   quantity = _quantity;
   side = _side;
 }
 
-double Order::GetPrice() const
+TickPrice Order::GetPrice() const
 {
   return price;
 }
@@ -208,83 +461,381 @@ const Order& BidOffer::GetOfferOrder() const
 }
 
 template<typename T>
-OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack) :
-  product(_product), bidStack(_bidStack), offerStack(_offerStack)
+LevelUpdate<T>::LevelUpdate(const T &_product, PricingSide _side, LevelAction _action, TickPrice _price, long _quantity) :
+  product(_product), side(_side), action(_action), price(_price), quantity(_quantity)
 {
 }
 
 template<typename T>
-const T& OrderBook<T>::GetProduct() const
+const T& LevelUpdate<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
-const vector<Order>& OrderBook<T>::GetBidStack() const
+PricingSide LevelUpdate<T>::GetSide() const
 {
-  return bidStack;
+  return side;
 }
 
 template<typename T>
-const vector<Order>& OrderBook<T>::GetOfferStack() const
+LevelAction LevelUpdate<T>::GetAction() const
 {
-  return offerStack;
+  return action;
 }
 
+template<typename T>
+TickPrice LevelUpdate<T>::GetPrice() const
+{
+  return price;
+}
 
 template<typename T>
-const BidOffer& OrderBook<T>::GetBestBidOffer() const
+long LevelUpdate<T>::GetQuantity() const
+{
+  return quantity;
+}
+
+template<int Depth>
+BookSide<Depth>::BookSide() :
+  size(0)
+{
+}
+
+template<int Depth>
+int BookSide<Depth>::Size() const
+{
+  return size;
+}
+
+template<int Depth>
+bool BookSide<Depth>::Empty() const
+{
+  return size == 0;
+}
+
+template<int Depth>
+TickPrice BookSide<Depth>::GetPrice(int level) const
+{
+  return prices[level];
+}
+
+template<int Depth>
+long BookSide<Depth>::GetQuantity(int level) const
+{
+  return quantities[level];
+}
+
+template<int Depth>
+int BookSide<Depth>::Find(TickPrice price) const
+{
+	for (int level = 0; level < size; level++)
+	{
+		if (prices[level] == price) return level;
+	}
+	return -1;
+}
+
+template<int Depth>
+bool BookSide<Depth>::Push(TickPrice price, long quantity)
+{
+	if (size == Depth) return false;
+	prices[size] = price;
+	quantities[size] = quantity;
+	size++;
+	return true;
+}
+
+template<int Depth>
+bool BookSide<Depth>::Insert(int level, TickPrice price, long quantity)
+{
+	if (size == Depth) return false;
+	for (int i = size; i > level; i--)
+	{
+		prices[i] = prices[i - 1];
+		quantities[i] = quantities[i - 1];
+	}
+	prices[level] = price;
+	quantities[level] = quantity;
+	size++;
+	return true;
+}
+
+template<int Depth>
+void BookSide<Depth>::SetQuantity(int level, long quantity)
+{
+  quantities[level] = quantity;
+}
+
+template<int Depth>
+void BookSide<Depth>::Erase(int level)
+{
+	size--;
+	for (int i = level; i < size; i++)
+	{
+		prices[i] = prices[i + 1];
+		quantities[i] = quantities[i + 1];
+	}
+}
+
+int BookSide<0>::Size() const
+{
+  return prices.size();
+}
+
+bool BookSide<0>::Empty() const
+{
+  return prices.empty();
+}
+
+TickPrice BookSide<0>::GetPrice(int level) const
+{
+  return prices[level];
+}
+
+long BookSide<0>::GetQuantity(int level) const
+{
+  return quantities[level];
+}
+
+int BookSide<0>::Find(TickPrice price) const
 {
-	double bestbid = bidStack[0].GetPrice();
-	Order bestbidOrder;
-	for (auto tmp : bidStack)
+	for (size_t level = 0; level < prices.size(); level++)
 	{
-		double price = tmp.GetPrice();
-		if (price >= bestbid)
+		if (prices[level] == price) return level;
+	}
+	return -1;
+}
+
+bool BookSide<0>::Push(TickPrice price, long quantity)
+{
+	prices.push_back(price);
+	quantities.push_back(quantity);
+	return true;
+}
+
+bool BookSide<0>::Insert(int level, TickPrice price, long quantity)
+{
+	prices.insert(prices.begin() + level, price);
+	quantities.insert(quantities.begin() + level, quantity);
+	return true;
+}
+
+void BookSide<0>::SetQuantity(int level, long quantity)
+{
+  quantities[level] = quantity;
+}
+
+void BookSide<0>::Erase(int level)
+{
+	prices.erase(prices.begin() + level);
+	quantities.erase(quantities.begin() + level);
+}
+
+template<typename T, int Depth>
+OrderBook<T, Depth>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack) :
+  product(_product)
+{
+  for (auto& order : _bidStack) AddLevel(BID, order.GetPrice(), order.GetQuantity());
+  for (auto& order : _offerStack) AddLevel(OFFER, order.GetPrice(), order.GetQuantity());
+}
+
+template<typename T, int Depth>
+OrderBook<T, Depth>::OrderBook(const T &_product) :
+  product(_product)
+{
+}
+
+template<typename T, int Depth>
+const T& OrderBook<T, Depth>::GetProduct() const
+{
+  return product.Get();
+}
+
+template<typename T, int Depth>
+const BookSide<Depth>& OrderBook<T, Depth>::GetBidStack() const
+{
+  return bidStack;
+}
+
+template<typename T, int Depth>
+const BookSide<Depth>& OrderBook<T, Depth>::GetOfferStack() const
+{
+  return offerStack;
+}
+
+// Of levels at the same price, the last one is the best.
+template<typename T, int Depth>
+bool OrderBook<T, Depth>::AddLevel(PricingSide side, TickPrice price, long quantity)
+{
+	BookSide<Depth>& stack = side == BID ? bidStack : offerStack;
+	if (!stack.Push(price, quantity)) return false;
+
+	const Order& best = side == BID ? bestBidOffer.GetBidOrder() : bestBidOffer.GetOfferOrder();
+	if (stack.Size() == 1 || (side == BID ? price >= best.GetPrice() : price <= best.GetPrice()))
+	{
+		SetBest(Order(price, quantity, side));
+	}
+	return true;
+}
+
+
+template<typename T, int Depth>
+const BidOffer& OrderBook<T, Depth>::GetBestBidOffer() const
+{
+	return bestBidOffer;
+}
+
+template<typename T, int Depth>
+void OrderBook<T, Depth>::SetBest(const Order& order)
+{
+	if (order.GetSide() == BID) bestBidOffer = BidOffer(order, bestBidOffer.GetOfferOrder());
+	else bestBidOffer = BidOffer(bestBidOffer.GetBidOrder(), order);
+}
+
+template<typename T, int Depth>
+void OrderBook<T, Depth>::ScanBest(PricingSide side)
+{
+	// level events can empty a side
+	const BookSide<Depth>& stack = side == BID ? bidStack : offerStack;
+	Order best(0, 0, side);
+	for (int level = 0; level < stack.Size(); level++)
+	{
+		TickPrice price = stack.GetPrice(level);
+		if (level == 0 || (side == BID ? price >= best.GetPrice() : price <= best.GetPrice()))
 		{
-			bestbid = price;
-			bestbidOrder = tmp;
+			best = Order(price, stack.GetQuantity(level), side);
 		}
 	}
+	SetBest(best);
+}
 
-	double bestoffer = offerStack[0].GetPrice();
-	Order bestofferOrder;
-	for (auto tmp : offerStack)
+// Books are a handful of levels deep, so finding the level is a short scan of one side.
+template<typename T, int Depth>
+bool OrderBook<T, Depth>::ApplyLevel(PricingSide side, LevelAction action, TickPrice price, long quantity)
+{
+	BookSide<Depth>& stack = side == BID ? bidStack : offerStack;
+	int level = stack.Find(price);
+
+	if (action == LEVEL_DELETE)
+	{
+		if (level < 0) return false;
+		stack.Erase(level);
+	}
+	else if (level < 0)
 	{
-		double price = tmp.GetPrice();
-		if (price  <= bestoffer)
+		level = 0;
+		while (level < stack.Size() && (side == BID ? stack.GetPrice(level) >= price : stack.GetPrice(level) <= price)) level++;
+		if (!stack.Insert(level, price, quantity))
 		{
-			bestoffer = price;
-			bestofferOrder = tmp;
+			// full: the worst level goes, unless the new one would come after it
+			if (level == stack.Size()) return false;
+			stack.Erase(stack.Size() - 1);
+			stack.Insert(level, price, quantity);
 		}
+		action = LEVEL_ADD;
+	}
+	else
+	{
+		action = LEVEL_MODIFY;
+		stack.SetQuantity(level, quantity);
+	}
+	lastChange = LevelChange{ side, action, level };
+
+	// a better price becomes the best; a change at the best price, a delete included, scans the side again
+	const Order& best = side == BID ? bestBidOffer.GetBidOrder() : bestBidOffer.GetOfferOrder();
+	bool better = side == BID ? price > best.GetPrice() : price < best.GetPrice();
+	if (action != LEVEL_DELETE && (stack.Size() == 1 || better))
+	{
+		SetBest(Order(price, quantity, side));
+	}
+	else if (price == best.GetPrice())
+	{
+		ScanBest(side);
 	}
+	return true;
+}
 
-	return BidOffer(bestbidOrder, bestofferOrder);
+template<typename T, int Depth>
+const LevelChange& OrderBook<T, Depth>::GetLastChange() const
+{
+	return lastChange;
 }
 
 
 template<typename T>
-MarketDataService<T>::MarketDataService()
-	:bookDepth(5) {}
+MarketDataService<T>::MarketDataService(int _bookDepth)
+	:bookDepth(_bookDepth), metrics("MarketDataService") {}
 
 
 template<typename T>
-OrderBook<T>& MarketDataService<T>::GetData(string key)
+OrderBook<T>& MarketDataService<T>::GetData(const string& key)
+{
+	return orderBooks[GetProductIndex(key)];
+}
+
+template<typename T>
+OrderBook<T>& MarketDataService<T>::GetData(int productIndex)
 {
-	return orderBooks[key];
+	return orderBooks[productIndex];
 }
 
 template<typename T>
 void MarketDataService<T>::OnMessage(OrderBook<T>& data)
 {
-	orderBooks[data.GetProduct().GetTicker()] = data;
+	orderBooks[data.GetProduct().GetIndex()] = data;
+	aggregates[data.GetProduct().GetIndex()].stale = true;
+	metrics.In();
+	metrics.SetSize(orderBooks.Size());
 
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(data);
 	}
 }
 
+template<typename T>
+void MarketDataService<T>::OnMessageBatch(OrderBook<T>* data, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		orderBooks[data[i].GetProduct().GetIndex()] = data[i];
+		aggregates[data[i].GetProduct().GetIndex()].stale = true;
+	}
+	metrics.In(n);
+	metrics.SetSize(orderBooks.Size());
+
+	ListenerTimer timer(metrics, n * listeners.size());
+	for (auto l : listeners)
+	{
+		l->ProcessAddBatch(data, n);
+	}
+}
+
+template<typename T>
+void MarketDataService<T>::OnLevelUpdate(LevelUpdate<T>& update)
+{
+	int index = update.GetProduct().GetIndex();
+	metrics.In();
+	// a delete has nothing to remove from a ticker without a book, and must not make one
+	if (!orderBooks.Contains(index))
+	{
+		if (update.GetAction() == LEVEL_DELETE) return;
+		orderBooks[index] = OrderBook<T>(update.GetProduct());
+	}
+	OrderBook<T>& orderBook = orderBooks[index];
+	metrics.SetSize(orderBooks.Size());
+	if (!orderBook.ApplyLevel(update.GetSide(), update.GetAction(), update.GetPrice(), update.GetQuantity())) return;
+	aggregates[index].stale = true;
+
+	ListenerTimer timer(metrics, listeners.size());
+	for (auto l : listeners)
+	{
+		l->ProcessUpdate(orderBook);
+	}
+}
+
 template<typename T>
 void MarketDataService<T>::AddListener(ServiceListener<OrderBook<T>>* listener)
 {
@@ -301,20 +852,65 @@ const vector<ServiceListener<OrderBook<T>>*>& MarketDataService<T>::GetListeners
 template<typename T>
 const BidOffer& MarketDataService<T>::GetBestBidOffer(const string& ticker)
 {
-	return orderBooks[ticker].GetBestBidOffer();
+	return orderBooks[GetProductIndex(ticker)].GetBestBidOffer();
 }
 
 template<typename T>
 const OrderBook<T>& MarketDataService<T>::AggregateDepth(const string& ticker)
 {
-	return orderBooks[ticker];
+	int index = GetProductIndex(ticker);
+	Aggregate& aggregate = aggregates[index];
+	if (!aggregate.stale || !orderBooks.Contains(index)) return aggregate.orderBook;
+
+	const OrderBook<T>& orderBook = orderBooks[index];
+	AggregateSide(orderBook.GetBidStack(), BID, bidLevels);
+	AggregateSide(orderBook.GetOfferStack(), OFFER, offerLevels);
+	aggregate.orderBook = OrderBook<T>(orderBook.GetProduct());
+	for (auto& level : bidLevels) aggregate.orderBook.AddLevel(BID, level.GetPrice(), level.GetQuantity());
+	for (auto& level : offerLevels) aggregate.orderBook.AddLevel(OFFER, level.GetPrice(), level.GetQuantity());
+	aggregate.stale = false;
+	return aggregate.orderBook;
+}
+
+template<typename T>
+int MarketDataService<T>::GetBookDepth() const
+{
+	return bookDepth;
+}
+
+// Books are a few levels deep: a sort and one pass beat anything cleverer.
+template<typename T>
+void MarketDataService<T>::AggregateSide(const BookSide<ORDER_BOOK_DEPTH>& stack, PricingSide side, vector<Order>& levels) const
+{
+	levels.clear();
+	for (int level = 0; level < stack.Size(); level++)
+	{
+		levels.push_back(Order(stack.GetPrice(level), stack.GetQuantity(level), side));
+	}
+	if (side == BID) sort(levels.begin(), levels.end(), [](const Order& a, const Order& b) { return a.GetPrice() > b.GetPrice(); });
+	else sort(levels.begin(), levels.end(), [](const Order& a, const Order& b) { return a.GetPrice() < b.GetPrice(); });
+
+	size_t n = 0;
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		if (n > 0 && levels[n - 1].GetPrice() == levels[i].GetPrice())
+		{
+			levels[n - 1] = Order(levels[i].GetPrice(), levels[n - 1].GetQuantity() + levels[i].GetQuantity(), side);
+		}
+		else
+		{
+			if ((int)n == bookDepth) break;
+			levels[n++] = levels[i];
+		}
+	}
+	levels.resize(n);
 }
 
 
 
 template<typename T>
-MDConnector<T>::MDConnector(MarketDataService<T>* service)
-	:MDS(service) {}
+MDConnector<T>::MDConnector(MarketDataService<T>* service, ReadMode _mode, int _threads)
+	:MDS(service), mode(_mode), threads(_threads < 1 ? 1 : _threads), metrics("MDConnector") {}
 
 
 template<typename T>
@@ -324,35 +920,187 @@ void MDConnector<T>::Publish(OrderBook<T>& _data) {}
 template<typename T>
 void MDConnector<T>::Consume(string file_name)
 {
-	ifstream file(file_name);
-	string line;
-	while (getline(file, line))
+	stats.Start();
+	long lines;
+	if (mode == MAPPED_READ && threads > 1)
+	{
+		lines = ConsumeParallel(file_name);
+	}
+	else
+	{
+		vector<OrderBook<T>> batch;
+		batch.reserve(CONNECTOR_BATCH_SIZE);
+		lines = ForEachRecord(file_name, mode, [this, &batch](const FieldRef* blocks, size_t n) {
+			batch.emplace_back();
+			if (!ParseRecord(blocks, n, batch.back())) batch.pop_back();
+			if (batch.size() == CONNECTOR_BATCH_SIZE)
+			{
+				metrics.Read(batch.size());
+				MDS->OnMessageBatch(batch.data(), batch.size());
+				batch.clear();
+			}
+		});
+		metrics.Read(batch.size());
+		if (!batch.empty()) MDS->OnMessageBatch(batch.data(), batch.size());
+	}
+	stats.Stop(lines);
+}
+
+template<typename T>
+void MDConnector<T>::ConsumeUpdates(string file_name)
+{
+	stats.Start();
+	long lines = ForEachRecord(file_name, mode, [this](const FieldRef* blocks, size_t n) {
+		LevelUpdate<T> update;
+		if (!ParseUpdate(blocks, n, update)) return;
+		metrics.Read();
+		MDS->OnLevelUpdate(update);
+	});
+	stats.Stop(lines);
+}
+
+template<typename T>
+void MDConnector<T>::Follow(FollowReader& reader)
+{
+	stats.Start();
+	long lines = FollowRecords(reader, [this](const FieldRef* blocks, size_t n) {
+		OrderBook<T> orderBook;
+		if (!ParseRecord(blocks, n, orderBook)) return;
+		metrics.Read();
+		MDS->OnMessage(orderBook);
+	});
+	stats.Stop(lines);
+}
+
+// The file is cut into chunks at line boundaries. Up to 'threads' chunks are
+// parsed concurrently, while this thread hands the parsed books of the oldest
+// chunk to the service. Chunks are delivered strictly in file order, so every
+// ticker's books reach MarketDataService in their original sequence.
+template<typename T>
+long MDConnector<T>::ConsumeParallel(const string& file_name)
+{
+	MappedFile file(file_name);
+	const char* pos = file.Data();
+	const char* end = pos + file.Size();
+	FieldRef chunk;
+	long lines = 0;
+
+	deque<future<void>> pending;
+	deque<vector<OrderBook<T>>> parsed;
+	while (true)
 	{
-		stringstream linestream(line); string block;
-		vector<string> blocks;
-		while (getline(linestream, block, ','))
+		while ((int)pending.size() < threads && NextChunk(pos, end, CSV_CHUNK_SIZE, chunk))
 		{
-            if ((block[block.size()-1] == '\r') || (block[block.size()-1] == '\n')){
-                block.erase(block.size()-1);
-            }
-			blocks.push_back(block);
+			parsed.emplace_back();
+			pending.push_back(async(launch::async, &MDConnector<T>::ParseChunk, chunk, &parsed.back()));
 		}
+		if (pending.empty()) break;
 
-		vector<Order> bidStack;
-		vector<Order> offerStack;
-
-		for (int i = 1; i < 11; i += 2) {
-			Order order(PriceSTD(blocks[i]), stol(blocks[i + 1]), BID);
-			bidStack.push_back(order);
+		pending.front().get();
+		vector<OrderBook<T>>& books = parsed.front();
+		metrics.Read(books.size());
+		for (size_t i = 0; i < books.size(); i += CONNECTOR_BATCH_SIZE)
+		{
+			MDS->OnMessageBatch(books.data() + i, min(CONNECTOR_BATCH_SIZE, books.size() - i));
 		}
+		lines += books.size();
+		pending.pop_front();
+		parsed.pop_front();
+	}
+	return lines;
+}
+
+// A line is the ticker followed by (price, size) pairs, bid levels first
+// and then the same number of offer levels.
+template<typename T>
+bool MDConnector<T>::ParseRecord(const FieldRef* blocks, size_t n, OrderBook<T>& orderBook)
+{
+	int depth = (n - 1) / 4;
+	if (depth == 0) return false;
+
+	orderBook = OrderBook<T>(GetBond(GetProductIndex(blocks[0].Begin(), blocks[0].End())));
+	for (int i = 1; i < 2 * depth + 1; i += 2) {
+		long quantity = stol(blocks[i + 1].ToString());
+		if (quantity != 0) orderBook.AddLevel(BID, PriceSTD(blocks[i].Begin(), blocks[i].End()), quantity);
+	}
+
+	for (int i = 2 * depth + 1; i < 4 * depth + 1; i += 2) {
+		long quantity = stol(blocks[i + 1].ToString());
+		if (quantity != 0) orderBook.AddLevel(OFFER, PriceSTD(blocks[i].Begin(), blocks[i].End()), quantity);
+	}
+	return true;
+}
+
+template<typename T>
+void MDConnector<T>::ParseChunk(FieldRef chunk, vector<OrderBook<T>>* books)
+{
+	CSVTokenizer tokenizer;
+	size_t n = tokenizer.Tokenize(chunk.Begin(), chunk.Size());
+	books->reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		books->emplace_back();
+		if (!ParseRecord(tokenizer.GetFields(i), tokenizer.GetFieldCount(i), books->back())) books->pop_back();
+	}
+}
+
+template<typename T>
+bool MDConnector<T>::ParseUpdate(const FieldRef* blocks, size_t n, LevelUpdate<T>& update)
+{
+	if (n < 5) return false;
+	int index = GetProductIndex(blocks[0].Begin(), blocks[0].End());
+	if (index < 0) return false;
+
+	PricingSide side;
+	if (blocks[1] == "BID") side = BID;
+	else if (blocks[1] == "OFFER") side = OFFER;
+	else return false;
+
+	LevelAction action;
+	if (blocks[2] == "ADD") action = LEVEL_ADD;
+	else if (blocks[2] == "MODIFY") action = LEVEL_MODIFY;
+	else if (blocks[2] == "DELETE") action = LEVEL_DELETE;
+	else return false;
+	update = LevelUpdate<T>(GetBond(index), side, action, PriceSTD(blocks[3].Begin(), blocks[3].End()), stol(blocks[4].ToString()));
+	return true;
+}
 
-		for (int i = 11; i < 21; i += 2) {
-			Order order(PriceSTD(blocks[i]), stol(blocks[i + 1]), OFFER);
-			offerStack.push_back(order);
+// Records are read straight out of the mapped file: no text to tokenize or parse.
+template<typename T>
+bool MDConnector<T>::ConsumeBinary(string file_name)
+{
+	stats.Start();
+	MappedFile file(file_name);
+	const MDRecord* records;
+	long n = GetMDRecords(file.Data(), file.Size(), records);
+	if (n < 0)
+	{
+		stats.Stop(0);
+		return false;
+	}
+
+	for (long r = 0; r < n; r++)
+	{
+		const MDRecord& record = records[r];
+		if (record.productIndex < 0 || record.productIndex >= PRODUCT_COUNT) continue;
+
+		OrderBook<T> orderBook(GetBond(record.productIndex));
+		for (int i = 0; i < MD_RECORD_DEPTH; i++)
+		{
+			if (record.bidSizes[i] > 0) orderBook.AddLevel(BID, record.bidPrices[i], record.bidSizes[i]);
+			if (record.offerSizes[i] > 0) orderBook.AddLevel(OFFER, record.offerPrices[i], record.offerSizes[i]);
 		}
-		OrderBook<T> orderBook(GetBond(blocks[0]), bidStack, offerStack);
+		metrics.Read();
 		MDS->OnMessage(orderBook);
 	}
+	stats.Stop(n);
+	return true;
+}
+
+template<typename T>
+const IngestStats& MDConnector<T>::GetStats() const
+{
+	return stats;
 }
 
 #endif
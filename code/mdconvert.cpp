@@ -0,0 +1,29 @@
+// Convert marketdata.txt to the binary market data format read by
+// MDConnector::ConsumeBinary.
+//
+// g++ -std=c++11 -O2 mdconvert.cpp -o mdconvert
+// ./mdconvert [marketdata.txt] [marketdata.bin]
+
+#include <iostream>
+#include <fstream>
+#include "binarymarketdata.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	string csv_file = argc > 1 ? argv[1] : "marketdata.txt";
+	string binary_file = argc > 2 ? argv[2] : "marketdata.bin";
+
+	long records = ConvertMarketData(csv_file, binary_file);
+	if (records < 0)
+	{
+		ifstream in(csv_file);
+		in.peek();
+		if (!in.is_open() || in.bad()) cout << "cannot read " << csv_file << endl;
+		else cout << "cannot write " << binary_file << endl;
+		return 1;
+	}
+	cout << records << " records written to " << binary_file << endl;
+	return 0;
+}
@@ -0,0 +1,541 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "latency.h"
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+using namespace std;
+
+// Cells of a counter; threads are spread over them so that they rarely share one
+const int METRIC_CELLS = 16;
+
+// Get the counter cell of the calling thread
+int MetricCell();
+
+/**
+* Counter bumped from any number of threads without locks.
+* Each thread adds to its own cell, on its own cache line, and a read sums
+* the cells.
+*/
+class Counter
+{
+
+public:
+
+	Counter();
+
+	void Add(uint64_t n = 1);
+
+	uint64_t Get() const;
+
+private:
+	struct Cell
+	{
+		atomic<uint64_t> value;
+		char pad[64 - sizeof(atomic<uint64_t>)];
+	};
+
+	// Counters are not 64 byte aligned (padding rather than alignas, which plain new
+	// does not honor before C++17). Values 64 bytes apart never share a line, and the
+	// pad keeps the line of the first one off whatever comes before the counter.
+	char pad[64];
+	Cell cells[METRIC_CELLS];
+
+};
+
+/**
+* Gauge holding the last value set.
+*/
+class Gauge
+{
+
+public:
+
+	Gauge();
+
+	void Set(int64_t _value);
+
+	int64_t Get() const;
+
+private:
+	atomic<int64_t> value;
+
+};
+
+/**
+* Registry of the counters and gauges of the process, exported in Prometheus
+* text format. Services and connectors get their metrics once, when they are
+* built, and then only touch them; a metric is identified by its name and
+* labels, so two services of the same kind and name share theirs.
+* Nothing is counted until Enable().
+*/
+class MetricsRegistry
+{
+
+public:
+
+	static void Enable(bool enabled = true);
+
+	static bool IsEnabled();
+
+	// Get a counter, e.g. GetCounter("soa_messages_in_total", "service=\"PricingService\"", "Messages received")
+	static Counter& GetCounter(const string& name, const string& labels, const string& help);
+
+	// Get a counter of ReadTSC ticks, exported in seconds
+	static Counter& GetTimer(const string& name, const string& labels, const string& help);
+
+	static Gauge& GetGauge(const string& name, const string& labels, const string& help);
+
+	// Write every metric in Prometheus text format
+	static void WritePrometheus(ostream& out);
+
+private:
+	enum MetricType { COUNTER, TIMER, GAUGE };
+	struct Metric
+	{
+		string name;
+		string labels;
+		string help;
+		MetricType type;
+		unique_ptr<Counter> counter;
+		unique_ptr<Gauge> gauge;
+	};
+
+	static Metric& Get(const string& name, const string& labels, const string& help, MetricType type);
+	static atomic<bool>& Enabled();
+	static mutex& MetricsMutex();
+	static deque<Metric>& Metrics();
+
+};
+
+/**
+* The metrics every service keeps: messages in, messages handed to listeners,
+* time spent in listeners and number of entries stored.
+*/
+class ServiceMetrics
+{
+
+public:
+
+	ServiceMetrics(const string& service);
+
+	// Count messages received
+	void In(uint64_t n = 1);
+
+	// Set the number of entries stored
+	void SetSize(size_t size);
+
+	Counter& messagesIn;
+	Counter& messagesOut;
+	Counter& listenerTicks;
+	Gauge& size;
+
+};
+
+/**
+* The metrics of a connector: records read and bytes written.
+*/
+class ConnectorMetrics
+{
+
+public:
+
+	ConnectorMetrics(const string& connector);
+
+	// Count records read
+	void Read(uint64_t n = 1);
+
+	// Count bytes written
+	void Written(uint64_t bytes);
+
+	Counter& recordsRead;
+	Counter& bytesWritten;
+
+};
+
+/**
+* Times the listener calls of a service until it goes out of scope, and
+* counts the messages handed on.
+*/
+class ListenerTimer
+{
+
+public:
+
+	ListenerTimer(ServiceMetrics& _metrics, uint64_t _messages);
+	~ListenerTimer();
+
+private:
+	ServiceMetrics& metrics;
+	uint64_t messages;
+	uint64_t start;
+
+};
+
+/**
+* Background thread exporting the registry. The target is either a file,
+* rewritten every interval, or an endpoint serving every request with the
+* current metrics over HTTP: "http:9100" listens on 127.0.0.1:9100 and
+* "unix:/tmp/soa.sock" on a Unix socket. Endpoints are only served on POSIX systems.
+*/
+class MetricsExporter
+{
+
+public:
+
+	MetricsExporter(const string& _target, int _intervalMillis = 1000);
+
+	// Writes the file one last time
+	~MetricsExporter();
+
+private:
+	MetricsExporter(const MetricsExporter&);
+	MetricsExporter& operator=(const MetricsExporter&);
+
+	void WriteFile();
+	void RunFile();
+	void RunEndpoint();
+	// Open the listening socket of the endpoint, -1 on failure
+	int Listen();
+	// Wait up to a second for a client socket to be ready for events. False on a
+	// timeout, an error or a stop, so that no client can hold up the exporter.
+	bool WaitClient(int client, short events);
+
+	string target;
+	int interval;
+	atomic<bool> stopping;
+	thread exporter;
+
+};
+
+
+
+
+/*    implementation     */
+int MetricCell()
+{
+	static atomic<int> next(0);
+	thread_local int cell = next.fetch_add(1) % METRIC_CELLS;
+	return cell;
+}
+
+
+Counter::Counter()
+{
+	for (auto& cell : cells) cell.value.store(0, memory_order_relaxed);
+}
+
+void Counter::Add(uint64_t n)
+{
+	cells[MetricCell()].value.fetch_add(n, memory_order_relaxed);
+}
+
+uint64_t Counter::Get() const
+{
+	uint64_t total = 0;
+	for (auto& cell : cells) total += cell.value.load(memory_order_relaxed);
+	return total;
+}
+
+
+Gauge::Gauge()
+	:value(0) {}
+
+void Gauge::Set(int64_t _value)
+{
+	value.store(_value, memory_order_relaxed);
+}
+
+int64_t Gauge::Get() const
+{
+	return value.load(memory_order_relaxed);
+}
+
+
+void MetricsRegistry::Enable(bool enabled)
+{
+	Enabled().store(enabled, memory_order_relaxed);
+}
+
+bool MetricsRegistry::IsEnabled()
+{
+	return Enabled().load(memory_order_relaxed);
+}
+
+Counter& MetricsRegistry::GetCounter(const string& name, const string& labels, const string& help)
+{
+	return *Get(name, labels, help, COUNTER).counter;
+}
+
+Counter& MetricsRegistry::GetTimer(const string& name, const string& labels, const string& help)
+{
+	return *Get(name, labels, help, TIMER).counter;
+}
+
+Gauge& MetricsRegistry::GetGauge(const string& name, const string& labels, const string& help)
+{
+	return *Get(name, labels, help, GAUGE).gauge;
+}
+
+void MetricsRegistry::WritePrometheus(ostream& out)
+{
+	lock_guard<mutex> lock(MetricsMutex());
+	// the samples of a name go together, under one HELP and TYPE
+	vector<string> names;
+	for (auto& metric : Metrics())
+	{
+		if (find(names.begin(), names.end(), metric.name) == names.end()) names.push_back(metric.name);
+	}
+	for (auto& name : names)
+	{
+		bool first = true;
+		for (auto& metric : Metrics())
+		{
+			if (metric.name != name) continue;
+			if (first)
+			{
+				out << "# HELP " << name << " " << metric.help << "\n";
+				out << "# TYPE " << name << " " << (metric.type == GAUGE ? "gauge" : "counter") << "\n";
+				first = false;
+			}
+			out << name << "{" << metric.labels << "} ";
+			if (metric.type == GAUGE) out << metric.gauge->Get();
+			else if (metric.type == TIMER) out << metric.counter->Get() * TSCNanos() * 1e-9;
+			else out << metric.counter->Get();
+			out << "\n";
+		}
+	}
+}
+
+MetricsRegistry::Metric& MetricsRegistry::Get(const string& name, const string& labels, const string& help, MetricType type)
+{
+	lock_guard<mutex> lock(MetricsMutex());
+	for (auto& metric : Metrics())
+	{
+		if (metric.name == name && metric.labels == labels) return metric;
+	}
+	Metrics().push_back(Metric());
+	Metric& metric = Metrics().back();
+	metric.name = name;
+	metric.labels = labels;
+	metric.help = help;
+	metric.type = type;
+	if (type == GAUGE) metric.gauge.reset(new Gauge());
+	else metric.counter.reset(new Counter());
+	return metric;
+}
+
+atomic<bool>& MetricsRegistry::Enabled()
+{
+	static atomic<bool> enabled(false);
+	return enabled;
+}
+
+mutex& MetricsRegistry::MetricsMutex()
+{
+	static mutex metricsMutex;
+	return metricsMutex;
+}
+
+deque<MetricsRegistry::Metric>& MetricsRegistry::Metrics()
+{
+	static deque<Metric> metrics;
+	return metrics;
+}
+
+
+ServiceMetrics::ServiceMetrics(const string& service)
+	:messagesIn(MetricsRegistry::GetCounter("soa_messages_in_total", "service=\"" + service + "\"", "Messages received by a service")),
+	messagesOut(MetricsRegistry::GetCounter("soa_messages_out_total", "service=\"" + service + "\"", "Messages handed to the listeners of a service, once per listener")),
+	listenerTicks(MetricsRegistry::GetTimer("soa_listener_seconds_total", "service=\"" + service + "\"", "Time spent in the listeners of a service")),
+	size(MetricsRegistry::GetGauge("soa_entries", "service=\"" + service + "\"", "Entries stored by a service")) {}
+
+void ServiceMetrics::In(uint64_t n)
+{
+	if (MetricsRegistry::IsEnabled()) messagesIn.Add(n);
+}
+
+void ServiceMetrics::SetSize(size_t _size)
+{
+	if (MetricsRegistry::IsEnabled()) size.Set(_size);
+}
+
+
+ConnectorMetrics::ConnectorMetrics(const string& connector)
+	:recordsRead(MetricsRegistry::GetCounter("soa_records_read_total", "connector=\"" + connector + "\"", "Records read by a connector")),
+	bytesWritten(MetricsRegistry::GetCounter("soa_bytes_written_total", "connector=\"" + connector + "\"", "Bytes written by a connector")) {}
+
+void ConnectorMetrics::Read(uint64_t n)
+{
+	if (MetricsRegistry::IsEnabled()) recordsRead.Add(n);
+}
+
+void ConnectorMetrics::Written(uint64_t bytes)
+{
+	if (MetricsRegistry::IsEnabled()) bytesWritten.Add(bytes);
+}
+
+
+ListenerTimer::ListenerTimer(ServiceMetrics& _metrics, uint64_t _messages)
+	:metrics(_metrics), messages(_messages), start(MetricsRegistry::IsEnabled() ? ReadTSC() : 0) {}
+
+ListenerTimer::~ListenerTimer()
+{
+	if (start == 0) return;
+	metrics.listenerTicks.Add(ReadTSC() - start);
+	metrics.messagesOut.Add(messages);
+}
+
+
+MetricsExporter::MetricsExporter(const string& _target, int _intervalMillis)
+	:target(_target), interval(_intervalMillis), stopping(false)
+{
+	bool endpoint = target.compare(0, 5, "http:") == 0 || target.compare(0, 5, "unix:") == 0;
+	if (endpoint) exporter = thread(&MetricsExporter::RunEndpoint, this);
+	else exporter = thread(&MetricsExporter::RunFile, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	stopping.store(true);
+	exporter.join();
+}
+
+void MetricsExporter::WriteFile()
+{
+	// write aside and rename, so that readers never see half a file
+	string tmp = target + ".tmp";
+	{
+		ofstream out(tmp);
+		MetricsRegistry::WritePrometheus(out);
+	}
+	rename(tmp.c_str(), target.c_str());
+}
+
+void MetricsExporter::RunFile()
+{
+	auto next = chrono::steady_clock::now();
+	while (!stopping.load())
+	{
+		next += chrono::milliseconds(interval);
+		while (!stopping.load() && chrono::steady_clock::now() < next)
+		{
+			this_thread::sleep_until(min(next, chrono::steady_clock::now() + chrono::milliseconds(10)));
+		}
+		WriteFile();
+	}
+}
+
+bool MetricsExporter::WaitClient(int client, short events)
+{
+#ifndef _WIN32
+	// short slices, so that a stop is seen within 100 ms
+	for (int waited = 0; waited < 1000 && !stopping.load(); waited += 100)
+	{
+		pollfd pfd;
+		pfd.fd = client;
+		pfd.events = events;
+		int ready = poll(&pfd, 1, 100);
+		if (ready < 0) return false;
+		if (ready > 0) return (pfd.revents & events) != 0;
+	}
+#endif
+	return false;
+}
+
+void MetricsExporter::RunEndpoint()
+{
+#ifndef _WIN32
+	int server = Listen();
+	if (server < 0) return;
+	while (!stopping.load())
+	{
+		pollfd pfd;
+		pfd.fd = server;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 100) <= 0) continue;
+		int client = accept(server, nullptr, nullptr);
+		if (client < 0) continue;
+		// the request itself does not matter, every path gets the metrics
+		char request[1024];
+		if (!WaitClient(client, POLLIN) || read(client, request, sizeof(request)) < 0)
+		{
+			close(client);
+			continue;
+		}
+		ostringstream body;
+		MetricsRegistry::WritePrometheus(body);
+		string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+			to_string(body.str().size()) + "\r\nConnection: close\r\n\r\n" + body.str();
+		size_t sent = 0;
+		while (sent < response.size() && WaitClient(client, POLLOUT))
+		{
+			// a client gone away must not raise SIGPIPE
+			ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+			if (n <= 0) break;
+			sent += n;
+		}
+		close(client);
+	}
+	close(server);
+	if (target.compare(0, 5, "unix:") == 0) unlink(target.c_str() + 5);
+#endif
+}
+
+int MetricsExporter::Listen()
+{
+#ifndef _WIN32
+	int server = -1;
+	if (target.compare(0, 5, "unix:") == 0)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, target.c_str() + 5, sizeof(address.sun_path) - 1);
+		unlink(address.sun_path);
+		server = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server < 0) return -1;
+		if (::bind(server, (sockaddr*)&address, sizeof(address)) < 0) { close(server); return -1; }
+	}
+	else
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(atoi(target.c_str() + 5));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		server = socket(AF_INET, SOCK_STREAM, 0);
+		if (server < 0) return -1;
+		int reuse = 1;
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (::bind(server, (sockaddr*)&address, sizeof(address)) < 0) { close(server); return -1; }
+	}
+	if (listen(server, 8) < 0) { close(server); return -1; }
+	return server;
+#else
+	return -1;
+#endif
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
 #include "tools.h"
+#include "metrics.h"
 
 using namespace std;
 
@@ -45,7 +46,7 @@ public:
   string To_string();
 
 private:
-  T product;
+  ProductRef<T> product;
   map<string,long> positions;
 
 };
@@ -84,14 +85,16 @@ template<typename T>
 class PositionService : public Service<string,Position <T> >
 {
 private:
-	map<string, Position<T>> positions;
+	ProductTable<Position<T>> positions;
 	vector<ServiceListener<Position<T>>*> listeners;
 	PositionListener<T>* listener;
+	ServiceMetrics metrics;
 public:
 	PositionService();
 
 	// Get data on our service given a key
-	Position<T>& GetData(string key);
+	Position<T>& GetData(const string& key);
+	Position<T>& GetData(int productIndex);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Position<T>& data);
@@ -125,7 +128,7 @@ Position<T>::Position(const T &_product) :
 template<typename T>
 const T& Position<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
@@ -154,7 +157,7 @@ void Position<T>::AddPosition(string &book, long pos)
 template<typename T>
 string Position<T>::To_string()
 {
-	string res = product.GetTicker() + ", ";
+	string res = product->GetTicker() + ", ";
 	long _sum = 0;
 	for (auto p : positions)
 	{
@@ -189,13 +192,19 @@ void PositionListener<T>::ProcessUpdate(Trade<T>& data) {}
 
 template<typename T>
 PositionService<T>::PositionService()
-	:listener(new PositionListener<T>(this)) {}
+	:listener(new PositionListener<T>(this)), metrics("PositionService") {}
 
 
 template<typename T>
-Position<T>& PositionService<T>::GetData(string key)
+Position<T>& PositionService<T>::GetData(const string& key)
 {
-	return positions[key];
+	return positions[GetProductIndex(key)];
+}
+
+template<typename T>
+Position<T>& PositionService<T>::GetData(int productIndex)
+{
+	return positions[productIndex];
 }
 
 template<typename T>
@@ -224,28 +233,30 @@ const vector<ServiceListener<Position<T>>*>& PositionService<T>::GetListeners()
 template<typename T>
 void PositionService<T>::AddTrade(const Trade<T>& trade)
 {
-	string ticker = trade.GetProduct().GetTicker();
+	int index = trade.GetProduct().GetIndex();
 	string book = trade.GetBook();
 	Side side = trade.GetSide();
 
-	if (positions.find(ticker) == positions.end()) {
-		positions[ticker] = Position<T>(GetBond(ticker));
+	if (!positions.Contains(index)) {
+		positions[index] = Position<T>(trade.GetProduct());
 	}
 
 	switch (side)
 	{
 	case BUY:
-		positions[ticker].AddPosition(book, trade.GetQuantity());
+		positions[index].AddPosition(book, trade.GetQuantity());
 		break;
 	case SELL:
-		positions[ticker].AddPosition(book, -trade.GetQuantity());
+		positions[index].AddPosition(book, -trade.GetQuantity());
 		break;
 	}
+	metrics.In();
+	metrics.SetSize(positions.Size());
 
-
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
-		l->ProcessAdd(positions[ticker]);
+		l->ProcessAdd(positions[index]);
 	}
 }
 
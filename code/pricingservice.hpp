@@ -12,7 +12,10 @@
 #include <iostream>
 #include "tools.h"
 #include "soa.hpp"
-#include <unordered_map>
+#include "csvtokenizer.h"
+#include "followreader.h"
+#include "latency.h"
+#include "metrics.h"
 #include <sstream>
 
 /**
@@ -27,24 +30,30 @@ public:
 
   // ctor for a price
   Price() = default;
-  Price(const T &_product, double _mid, double _bidOfferSpread);
+  Price(const T &_product, TickPrice _mid, TickPrice _bidOfferSpread);
 
   // Get the product
   const T& GetProduct() const;
 
-  // Get the mid price
-  double GetMid() const;
+  // Get the mid price, rounded down to a whole tick
+  TickPrice GetMid() const;
 
   // Get the bid/offer spread around the mid
-  double GetBidOfferSpread() const;
+  TickPrice GetBidOfferSpread() const;
+
+  // Get the TSC stamp of when the price was read, 0 when not traced
+  uint64_t GetIngestTicks() const;
+
+  void SetIngestTicks(uint64_t _ingestTicks);
 
   //string to print
   string To_string();
 
 private:
-  T product;
-  double mid;
-  double bidOfferSpread;
+  ProductRef<T> product;
+  TickPrice mid;
+  TickPrice bidOfferSpread;
+  uint64_t ingestTicks = 0;
 
 };
 
@@ -58,14 +67,20 @@ class PricingService : public Service<string,Price <T> >
 {
 private:
 	vector<ServiceListener<Price<T>>*> listeners;
-	unordered_map<string, Price<T>> prices;
+	ProductTable<Price<T>> prices;
+	LatencyHistogram* hop;
+	ServiceMetrics metrics;
 
 public:
 	PricingService();
-	Price <T>& GetData(string key);
+	Price <T>& GetData(const string& key);
+	Price <T>& GetData(int productIndex);
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Price <T> & p);
 
+	// Store a batch of prices, then hand the whole batch to each listener
+	void OnMessageBatch(Price <T> * p, size_t n);
+
 	// Add a listener to the Service for callbacks on add, remove, and update events
 	// for data to the Service.
 	void AddListener(ServiceListener<Price <T>> *listener);
@@ -77,10 +92,22 @@ template<typename T> // with respect to ps, not template wrt connector itself
 class PSConnector : public Connector<Price<T>> {
 private:
 	PricingService<T>* ps;
+	ReadMode mode;
+	IngestStats stats;
+	ConnectorMetrics metrics;
+
+	// Turn one record of prices.txt into a Price. False if the record is too short.
+	bool ParseRecord(const FieldRef* blocks, size_t n, Price<T>& price);
 public:
-	PSConnector(PricingService<T>* _ps);
+	PSConnector(PricingService<T>* _ps, ReadMode _mode = STREAM_READ);
 	void Consume(std::string file_name);
 	void Publish(Price<T> &data);
+
+	// Read records as they are appended to a file or written to a pipe, until the reader ends
+	void Follow(FollowReader& reader);
+
+	// Line count and ingest rate of the last Consume
+	const IngestStats& GetStats() const;
 };
 
 
@@ -91,7 +118,7 @@ public:
 
 
 template<typename T>
-Price<T>::Price(const T &_product, double _mid, double _bidOfferSpread) :
+Price<T>::Price(const T &_product, TickPrice _mid, TickPrice _bidOfferSpread) :
   product(_product)
 {
   mid = _mid;
@@ -101,47 +128,83 @@ Price<T>::Price(const T &_product, double _mid, double _bidOfferSpread) :
 template<typename T>
 const T& Price<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
-double Price<T>::GetMid() const
+TickPrice Price<T>::GetMid() const
 {
   return mid;
 }
 
 template<typename T>
-double Price<T>::GetBidOfferSpread() const
+TickPrice Price<T>::GetBidOfferSpread() const
 {
   return bidOfferSpread;
 }
 
 
+template<typename T>
+uint64_t Price<T>::GetIngestTicks() const
+{
+  return ingestTicks;
+}
+
+template<typename T>
+void Price<T>::SetIngestTicks(uint64_t _ingestTicks)
+{
+  ingestTicks = _ingestTicks;
+}
+
+
 template<typename T>
 string Price<T>::To_string()
 {
-	return product.GetTicker() + ": " + "mid price " + PriceDTS(mid) +
-		", spread " + to_string(bidOfferSpread);
+	return product->GetTicker() + ": " + "mid price " + PriceDTS(mid) +
+		", spread " + to_string(TicksToPoints(bidOfferSpread));
+}
+template<typename T>
+PricingService<T>::PricingService()
+	:hop(&LatencyTrace::Hop("PricingService")), metrics("PricingService") {
 }
+
 template<typename T>
-PricingService<T>::PricingService() {
+Price <T>& PricingService<T>::GetData(const string& key) {
+	return prices[GetProductIndex(key)];
 }
 
 template<typename T>
-Price <T>& PricingService<T>::GetData(string key) {
-	return prices[key];
+Price <T>& PricingService<T>::GetData(int productIndex) {
+	return prices[productIndex];
 }
 
 template<typename T>
 void PricingService<T>::OnMessage(Price <T> & p) {
-	//prices.insert(unordered_map<string, Price<T>>::value_type(p.GetProduct().GetTicker(), p));
-	prices[p.GetProduct().GetTicker()] = p;
+	prices[p.GetProduct().GetIndex()] = p;
+	hop->RecordSince(p.GetIngestTicks());
+	metrics.In();
+	metrics.SetSize(prices.Size());
 	//cout << p.GetBidOfferSpread() <<','<< p.GetMid() << endl;
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners) {
 		l->ProcessAdd(p);
 	}
 }
 
+template<typename T>
+void PricingService<T>::OnMessageBatch(Price <T> * p, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		prices[p[i].GetProduct().GetIndex()] = p[i];
+		hop->RecordSince(p[i].GetIngestTicks());
+	}
+	metrics.In(n);
+	metrics.SetSize(prices.Size());
+	ListenerTimer timer(metrics, n * listeners.size());
+	for (auto l : listeners) {
+		l->ProcessAddBatch(p, n);
+	}
+}
+
 template<typename T>
 void PricingService<T>::AddListener(ServiceListener<Price <T>> *listener) {
 	listeners.push_back(listener);
@@ -153,33 +216,66 @@ const vector< ServiceListener<Price <T>>* >& PricingService<T>::GetListeners() c
 }
 
 template<typename T>
-PSConnector<T>::PSConnector(PricingService<T>* _ps): ps(_ps){}
+PSConnector<T>::PSConnector(PricingService<T>* _ps, ReadMode _mode): ps(_ps), mode(_mode), metrics("PSConnector"){}
 
 template<typename T>
 void PSConnector<T>::Consume(std::string file_name) {
-	ifstream file(file_name);
-	string line;
-	while (getline(file, line))
-	{
-		stringstream linestream(line); string block;
-		vector<string> blocks;
-		while (getline(linestream, block, ','))
-		{
-            if ((block[block.size()-1] == '\r') || (block[block.size()-1] == '\n')){
-                block.erase(block.size()-1);
-            }
-			blocks.push_back(block);
+	stats.Start();
+	vector<Price<T>> batch;
+	batch.reserve(CONNECTOR_BATCH_SIZE);
+	long lines = ForEachRecord(file_name, mode, [this, &batch](const FieldRef* blocks, size_t n) {
+		batch.emplace_back();
+		if (!ParseRecord(blocks, n, batch.back())) batch.pop_back();
+		if (batch.size() == CONNECTOR_BATCH_SIZE) {
+			metrics.Read(batch.size());
+			ps->OnMessageBatch(batch.data(), batch.size());
+			batch.clear();
 		}
+	});
+	metrics.Read(batch.size());
+	if (!batch.empty()) ps->OnMessageBatch(batch.data(), batch.size());
+	stats.Stop(lines);
+}
 
-		double _bidPrice = PriceSTD(blocks[1]);
-		double _offerPrice = PriceSTD(blocks[2]);
-		double _midPrice = (_bidPrice + _offerPrice) / 2.0;
-		double _spread = _offerPrice - _bidPrice;
-		Price<T> _price(GetBond(blocks[0]), _midPrice, _spread);
+template<typename T>
+void PSConnector<T>::Follow(FollowReader& reader) {
+	stats.Start();
+	// prices are passed on one by one as they arrive
+	long lines = FollowRecords(reader, [this](const FieldRef* blocks, size_t n) {
+		Price<T> _price;
+		if (!ParseRecord(blocks, n, _price)) return;
+		metrics.Read();
 		ps->OnMessage(_price);
-	}
+	});
+	stats.Stop(lines);
+}
+
+// Prices are decoded in place and the ticker fits in the small string
+// buffer, so a record costs no heap allocation.
+template<typename T>
+bool PSConnector<T>::ParseRecord(const FieldRef* blocks, size_t n, Price<T>& price) {
+	if (n < 3) return false;
+
+	uint64_t ingest = LatencyTrace::Stamp();
+	TickPrice _bidPrice = PriceSTD(blocks[1].Begin(), blocks[1].End());
+	TickPrice _offerPrice = PriceSTD(blocks[2].Begin(), blocks[2].End());
+	TickPrice _midPrice = (_bidPrice + _offerPrice) / 2;
+	TickPrice _spread = _offerPrice - _bidPrice;
+	price = Price<T>(GetBond(GetProductIndex(blocks[0].Begin(), blocks[0].End())), _midPrice, _spread);
+	price.SetIngestTicks(ingest);
+	return true;
+}
+
+template<typename T>
+const IngestStats& PSConnector<T>::GetStats() const {
+	return stats;
 }
 
 template<typename T>
 void PSConnector<T>::Publish(Price<T> &data) {}
+
+// copied into PSConnector batches, the tables of PricingService and GUIService,
+// and the AsyncListener ring and ConflatingListener slots in front of the GUI
+static_assert(is_trivially_copyable<Price<Bond>>::value, "Price must stay trivially copyable");
+
 #endif
@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include <string>
+#include <stdexcept>
 
 
 using namespace std;
@@ -27,7 +28,7 @@ public:
 
   // ctor for a prduct
   Product() = default;
-  Product(string _productId, ProductType _productType);
+  Product(string _productId, ProductType _productType, int _index = -1);
 
   // Get the product identifier
   const string& GetProductId() const;
@@ -35,9 +36,13 @@ public:
   // Ge the product type
   ProductType GetProductType() const;
 
+  // Get the dense index services key their per-product state on, -1 if not interned
+  int GetIndex() const;
+
 private:
   string productId;
   ProductType productType;
+  int index = -1;
 
 };
 
@@ -52,7 +57,7 @@ class Bond : public Product
 public:
 
   // ctor for a bond
-  Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, string _maturityDate);
+  Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, string _maturityDate, int _index = -1);
   Bond() = default;
 
   // Get the ticker
@@ -81,11 +86,56 @@ private:
 
 
 
+/**
+ * Registry of the immutable products of type T, indexed by product index.
+ * Specialized for every product type that messages refer to.
+ */
+template<typename T>
+struct ProductRegistry
+{
+
+  // Get the product of an index, an empty product for -1
+  static const T& Get(int index);
 
-Product::Product(string _productId, ProductType _productType)
+};
+
+/**
+ * Handle to a product of the registry, held by messages instead of a copy of
+ * the product. It is one pointer, so messages built only of handles and
+ * numbers are trivially copyable: Price, PriceStream and PV01, which assert it.
+ * Trade, Inquiry and ExecutionOrder keep string ids: most belong to one
+ * message, so interning them would add a table that grows with every message,
+ * and none of them is on the price path.
+ * OrderBook holds vectors unless built with ORDER_BOOK_DEPTH.
+ * Only products of the registry have a handle: building one from any other
+ * product throws invalid_argument rather than stand for a different product.
+ */
+template<typename T>
+class ProductRef
+{
+
+public:
+
+  // ctor for a handle, to the registry's copy of the product
+  ProductRef() = default;
+  ProductRef(const T &_product);
+
+  // Get the product
+  const T& Get() const;
+
+  const T* operator->() const;
+
+private:
+  const T* product = nullptr;
+
+};
+
+
+Product::Product(string _productId, ProductType _productType, int _index)
 {
   productId = _productId;
   productType = _productType;
+  index = _index;
 }
 
 const string& Product::GetProductId() const
@@ -98,7 +148,12 @@ ProductType Product::GetProductType() const
   return productType;
 }
 
-Bond::Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, string _maturityDate) : Product(_productId, BOND)
+int Product::GetIndex() const
+{
+  return index;
+}
+
+Bond::Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, string _maturityDate, int _index) : Product(_productId, BOND, _index)
 {
   bondIdType = _bondIdType;
   ticker = _ticker;
@@ -134,5 +189,26 @@ ostream& operator<<(ostream &output, const Bond &bond)
   return output;
 }
 
+template<typename T>
+ProductRef<T>::ProductRef(const T &_product) :
+  product(&ProductRegistry<T>::Get(_product.GetIndex()))
+{
+  // index -1 gets the empty product, so this also catches products never interned
+  if (product != &_product && product->GetProductId() != _product.GetProductId())
+    throw invalid_argument("product " + _product.GetProductId() + " is not in the registry");
+}
+
+template<typename T>
+const T& ProductRef<T>::Get() const
+{
+  return product ? *product : ProductRegistry<T>::Get(-1);
+}
+
+template<typename T>
+const T* ProductRef<T>::operator->() const
+{
+  return &Get();
+}
+
 
 #endif
@@ -9,8 +9,8 @@
 
 #include "soa.hpp"
 #include "positionservice.hpp"
-#include <unordered_map>
 #include "tools.h"
+#include "metrics.h"
 
 /**
  * PV01 risk.
@@ -38,21 +38,22 @@ public:
   double GetBucketPV01() const;
 
   string GetBucketName() const;
+  Bucket GetBucket() const;
 
   void SetBucketPV01(double v);
 
-  void SetBucketName(string name);
+  void SetBucket(Bucket _bucket);
 
   //string to print
   string To_string();
 
 private:
-  T product;
+  ProductRef<T> product;
   double pv01;
   long quantity;
 
   double bucket_pv01;
-  string bucket_name;
+  Bucket bucket;
 
 };
 
@@ -82,6 +83,28 @@ private:
 
 };
 
+/**
+ * Sectors are not in a product registry, so the handle of the PV01 of a
+ * sector holds a copy of the sector.
+ */
+template<typename T>
+class ProductRef< BucketedSector<T> >
+{
+
+public:
+
+  ProductRef(const BucketedSector<T> &_sector);
+
+  // Get the sector
+  const BucketedSector<T>& Get() const;
+
+  const BucketedSector<T>* operator->() const;
+
+private:
+  BucketedSector<T> sector;
+
+};
+
 template<typename T>
 class RiskService;
 
@@ -120,14 +143,15 @@ class RiskService : public Service<string,PV01 <T> >
 {
 private:
 
-	unordered_map<string, double> pv01s;
+	ProductTable<double> pv01s;
 	vector<ServiceListener<PV01<T>>*> listeners;
 	RiskListener<T>* listener;
+	ServiceMetrics metrics;
 public:
 	RiskService();
 
 	// Get data on our service given a key
-	PV01<T>& GetData(string key);
+	PV01<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(PV01<T>& data);
@@ -144,7 +168,7 @@ public:
 	void AddPosition(Position<T> &position);
 
   // Get the bucketed risk for the bucket sector
-  const PV01< BucketedSector<T> >& GetBucketedRisk(const BucketedSector<T> &sector) const;
+  PV01< BucketedSector<T> > GetBucketedRisk(const BucketedSector<T> &sector) const;
 
 };
 
@@ -161,7 +185,7 @@ PV01<T>::PV01(const T &_product, double _pv01, long _quantity)
 template<typename T>
 const T& PV01<T>::GetProduct() const
 {
-	return product;
+	return product.Get();
 }
 
 template<typename T>
@@ -191,20 +215,26 @@ void PV01<T>::SetBucketPV01(double v)
 template<typename T>
 string PV01<T>::GetBucketName() const
 {
-	return bucket_name;
+	return BUCKET_NAMES[bucket];
 }
 
 template<typename T>
-void PV01<T>::SetBucketName(string n)
+Bucket PV01<T>::GetBucket() const
 {
-	bucket_name = n;
+	return bucket;
+}
+
+template<typename T>
+void PV01<T>::SetBucket(Bucket _bucket)
+{
+	bucket = _bucket;
 }
 
 template<typename T>
 string PV01<T>::To_string()
 {
-	return product.GetTicker() + ", risk: " + to_string(pv01) + ", Quantity: "
-		+ to_string(quantity) + ", Bucket " + bucket_name + " risk: " +
+	return product->GetTicker() + ", risk: " + to_string(pv01) + ", Quantity: "
+		+ to_string(quantity) + ", Bucket " + BUCKET_NAMES[bucket] + " risk: " +
 		to_string(bucket_pv01);
 }
 
@@ -227,6 +257,24 @@ const string& BucketedSector<T>::GetName() const
   return name;
 }
 
+template<typename T>
+ProductRef<BucketedSector<T>>::ProductRef(const BucketedSector<T> &_sector) :
+  sector(_sector)
+{
+}
+
+template<typename T>
+const BucketedSector<T>& ProductRef<BucketedSector<T>>::Get() const
+{
+  return sector;
+}
+
+template<typename T>
+const BucketedSector<T>* ProductRef<BucketedSector<T>>::operator->() const
+{
+  return &sector;
+}
+
 
 template<typename T>
 RiskListener<T>::RiskListener(RiskService<T>* service)
@@ -247,11 +295,12 @@ void RiskListener<T>::ProcessUpdate(Position<T>& data) {}
 
 template<typename T>
 RiskService<T>::RiskService()
-	:listener(new RiskListener<T>(this)) {}
+	:listener(new RiskListener<T>(this)), metrics("RiskService") {}
 
 template<typename T>
-PV01<T>& RiskService<T>::GetData(string key) {
-    PV01<T>* tmp = new PV01<T>(GetBond(key), pv01s[key], 1);
+PV01<T>& RiskService<T>::GetData(const string& key) {
+    int index = GetProductIndex(key);
+    PV01<T>* tmp = new PV01<T>(GetBond(index), pv01s[index], 1);
     return *tmp;
 }
 
@@ -279,20 +328,25 @@ RiskListener<T>* RiskService<T>::GetListener()
 template<typename T>
 void RiskService<T>::AddPosition(Position<T>& position)
 {
-	string ticker = position.GetProduct().GetTicker();
+	int index = position.GetProduct().GetIndex();
 	long quantity = position.GetAggregatePosition();
-	pv01s[ticker] = GetPV01(ticker) * quantity;
+	pv01s[index] = GetPV01(index) * quantity;
 
-	vector<string> bucket = GetBucket(ticker);
+	Bucket bucket = GetBucket(index);
 	double bucket_pv01 = 0;
-	for (int i = 1; i < bucket.size(); i++) {
-		bucket_pv01 += pv01s[bucket[i]];
+	// read through the const table, which does not mark the products it reads as present
+	const ProductTable<double>& table = pv01s;
+	for (int i = 0; i < PRODUCT_COUNT; i++) {
+		if (GetBucket(i) == bucket) bucket_pv01 += table[i];
 	}
 
-	PV01<T> pv01(position.GetProduct(), pv01s[ticker], quantity);
-	pv01.SetBucketName(bucket[0]);
+	PV01<T> pv01(position.GetProduct(), pv01s[index], quantity);
+	pv01.SetBucket(bucket);
 	pv01.SetBucketPV01(bucket_pv01);
+	metrics.In();
+	metrics.SetSize(pv01s.Size());
 
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(pv01);
@@ -300,17 +354,19 @@ void RiskService<T>::AddPosition(Position<T>& position)
 }
 
 template<typename T>
-const PV01<BucketedSector<T>>& RiskService<T>::GetBucketedRisk(const BucketedSector<T>& sector) const
+PV01<BucketedSector<T>> RiskService<T>::GetBucketedRisk(const BucketedSector<T>& sector) const
 {
 	double pv01 = 0;
 
 	for (auto& p : sector.GetProducts())
 	{
-		pv01 += pv01s[p.GetTicker()];
+		pv01 += pv01s[p.GetIndex()];
 	}
 	return PV01<BucketedSector<T>>(sector, pv01, 1);
 }
 
-
+// built once per position and copied into the HistoricalDataService entry of its
+// product; RiskService itself keeps plain doubles
+static_assert(is_trivially_copyable<PV01<Bond>>::value, "PV01 must stay trivially copyable");
 
 #endif
@@ -0,0 +1,251 @@
+#ifndef SHARDEDMARKETDATA_HPP
+#define SHARDEDMARKETDATA_HPP
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "soa.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.h"
+#include "executionservice.hpp"
+
+using namespace std;
+
+/**
+* Listener handing the books it gets to a MarketDataService.
+*/
+template<typename T>
+class MarketDataFeed : public ServiceListener<OrderBook<T>>
+{
+
+public:
+
+	MarketDataFeed(MarketDataService<T>* _service);
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(OrderBook<T>& data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(OrderBook<T>& data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(OrderBook<T>& data);
+
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(OrderBook<T>* data, size_t n);
+
+private:
+	MarketDataService<T>* service;
+
+};
+
+/**
+* Market data service running the market data -> algo execution -> execution
+* chain on worker threads, one shard of tickers per worker.
+* A ticker always goes to the same shard, whose worker runs the whole chain
+* for it on its own MarketDataService, AlgoExecutionService and ExecutionService,
+* so the books of a ticker are handled in order. The shards only share:
+* - the count of algo orders, which alternate between bid and offer
+* - the execution orders, merged onto one thread for the listeners added with
+*   AddExecutionListener (e.g. HistoricalDataService and TradeBookingService)
+* Hand it to an MDConnector like a MarketDataService and Flush when done.
+* It overrides every MarketDataService call that reads or stores books, so the
+* books of the base stay empty. The base keeps the listeners added, for
+* GetListeners, and its metrics are the counters the shards add to.
+*/
+template<typename T>
+class ShardedMarketDataService : public MarketDataService<T>
+{
+
+public:
+
+	// At most one shard per product. The worker of shard i is pinned to cpu i.
+	// AggregateDepth keeps the best bookDepth price levels a side.
+	ShardedMarketDataService(int shardCount, int bookDepth = 5);
+
+	// Get data on our service given a key, from the shard of the ticker. Flush first.
+	OrderBook<T>& GetData(const string& key);
+	OrderBook<T>& GetData(int productIndex);
+
+	// Hand a book to the worker of its ticker
+	void OnMessage(OrderBook<T>& data);
+
+	// Hand a batch of books to the workers of their tickers
+	void OnMessageBatch(OrderBook<T>* data, size_t n);
+
+	// Apply a level event on the calling thread, once the worker of its ticker has caught up.
+	// Level events are not queued: they are meant for light streams between snapshots.
+	void OnLevelUpdate(LevelUpdate<T>& update);
+
+	// Add a listener to the market data of every shard. It is called from every worker.
+	void AddListener(ServiceListener<OrderBook<T>>* listener);
+
+	// Add a listener to the execution orders of every shard, called from the merge thread
+	void AddExecutionListener(ServiceListener<ExecutionOrder<T>>* listener);
+
+	// Wait until the workers and the merge thread have handled every book passed so far
+	void Flush();
+
+	// Get the best bid/offer order, kept by the book of the ticker
+	const BidOffer& GetBestBidOffer(const string& ticker);
+
+	// Aggregate the order book
+	const OrderBook<T>& AggregateDepth(const string& ticker);
+
+	int GetShardCount() const;
+
+	// Get the shard of a product
+	int GetShard(int productIndex) const;
+
+private:
+	struct Shard
+	{
+		Shard(int index, int bookDepth, atomic<long>* aggressions, MergeListener<ExecutionOrder<T>>* executions);
+
+		MarketDataService<T> MDS;
+		AlgoExecutionService<T> AES;
+		ExecutionService<T> ES;
+		MarketDataFeed<T> feed;
+		// last, so that the worker stops before the services go
+		AsyncListener<OrderBook<T>> worker;
+	};
+
+	atomic<long> aggressions;
+	MergeListener<ExecutionOrder<T>> executions;
+	vector<unique_ptr<Shard>> shards;
+
+};
+
+
+
+
+/*    implementation     */
+template<typename T>
+MarketDataFeed<T>::MarketDataFeed(MarketDataService<T>* _service)
+	:service(_service) {}
+
+template<typename T>
+void MarketDataFeed<T>::ProcessAdd(OrderBook<T>& data)
+{
+	service->OnMessage(data);
+}
+
+template<typename T>
+void MarketDataFeed<T>::ProcessRemove(OrderBook<T>& data) {}
+
+template<typename T>
+void MarketDataFeed<T>::ProcessUpdate(OrderBook<T>& data) {}
+
+template<typename T>
+void MarketDataFeed<T>::ProcessAddBatch(OrderBook<T>* data, size_t n)
+{
+	service->OnMessageBatch(data, n);
+}
+
+
+template<typename T>
+ShardedMarketDataService<T>::Shard::Shard(int index, int bookDepth, atomic<long>* aggressions, MergeListener<ExecutionOrder<T>>* executions)
+	:MDS(bookDepth), feed(&MDS), worker(&feed, 4096, index % max(1u, thread::hardware_concurrency()))
+{
+	MDS.AddListener(AES.GetListener());
+	AES.AddListener(ES.GetListener());
+	ES.AddListener(executions->GetInput(index));
+	AES.ShareAggressions(aggressions);
+}
+
+template<typename T>
+ShardedMarketDataService<T>::ShardedMarketDataService(int shardCount, int bookDepth)
+	:MarketDataService<T>(bookDepth), aggressions(0), executions(max(1, min(shardCount, PRODUCT_COUNT)))
+{
+	shardCount = max(1, min(shardCount, PRODUCT_COUNT));
+	for (int i = 0; i < shardCount; i++)
+	{
+		shards.push_back(unique_ptr<Shard>(new Shard(i, bookDepth, &aggressions, &executions)));
+	}
+}
+
+template<typename T>
+OrderBook<T>& ShardedMarketDataService<T>::GetData(const string& key)
+{
+	return GetData(GetProductIndex(key));
+}
+
+template<typename T>
+OrderBook<T>& ShardedMarketDataService<T>::GetData(int productIndex)
+{
+	return shards[GetShard(productIndex)]->MDS.GetData(productIndex);
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::OnMessage(OrderBook<T>& data)
+{
+	shards[GetShard(data.GetProduct().GetIndex())]->worker.ProcessAdd(data);
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::OnMessageBatch(OrderBook<T>* data, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		shards[GetShard(data[i].GetProduct().GetIndex())]->worker.ProcessAdd(data[i]);
+	}
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::OnLevelUpdate(LevelUpdate<T>& update)
+{
+	// the worker is idle after the flush, so the shard's services are ours until the next book
+	Shard& shard = *shards[GetShard(update.GetProduct().GetIndex())];
+	shard.worker.Flush();
+	shard.MDS.OnLevelUpdate(update);
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::AddListener(ServiceListener<OrderBook<T>>* listener)
+{
+	MarketDataService<T>::AddListener(listener);
+	for (auto& shard : shards) shard->MDS.AddListener(listener);
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::AddExecutionListener(ServiceListener<ExecutionOrder<T>>* listener)
+{
+	executions.AddListener(listener);
+}
+
+template<typename T>
+void ShardedMarketDataService<T>::Flush()
+{
+	// the workers push their executions before they count a book as handled
+	for (auto& shard : shards) shard->worker.Flush();
+	executions.Flush();
+}
+
+template<typename T>
+const BidOffer& ShardedMarketDataService<T>::GetBestBidOffer(const string& ticker)
+{
+	return GetData(ticker).GetBestBidOffer();
+}
+
+template<typename T>
+const OrderBook<T>& ShardedMarketDataService<T>::AggregateDepth(const string& ticker)
+{
+	int index = GetProductIndex(ticker);
+	return shards[GetShard(index)]->MDS.AggregateDepth(ticker);
+}
+
+template<typename T>
+int ShardedMarketDataService<T>::GetShardCount() const
+{
+	return shards.size();
+}
+
+template<typename T>
+int ShardedMarketDataService<T>::GetShard(int productIndex) const
+{
+	// unknown tickers (index -1) go to the first shard
+	return productIndex < 0 ? 0 : productIndex % shards.size();
+}
+
+#endif
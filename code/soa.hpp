@@ -9,6 +9,15 @@
 #define SOA_HPP
 
 #include <vector>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace std;
 
@@ -32,6 +41,13 @@ public:
   // Listener callback to process an update event to the Service
   virtual void ProcessUpdate(V &data) = 0;
 
+  // Listener callback to process add events for n contiguous items.
+  // Listeners that can amortize work over a batch override it.
+  virtual void ProcessAddBatch(V *data, size_t n)
+  {
+    for (size_t i = 0; i < n; i++) ProcessAdd(data[i]);
+  }
+
 };
 
 /**
@@ -45,11 +61,18 @@ class Service
 public:
 
   // Get data on our service given a key
-  virtual V& GetData(K key) = 0;
+  virtual V& GetData(const K& key) = 0;
 
   // The callback that a Connector should invoke for any new or updated data
   virtual void OnMessage(V &data) = 0;
 
+  // The callback that a Connector can invoke for n contiguous new or updated items.
+  // Services that pass batches on to their listeners override it.
+  virtual void OnMessageBatch(V *data, size_t n)
+  {
+    for (size_t i = 0; i < n; i++) OnMessage(data[i]);
+  }
+
   // Add a listener to the Service for callbacks on add, remove, and update events
   // for data to the Service.
   virtual void AddListener(ServiceListener<V> *listener) = 0;
@@ -78,4 +101,460 @@ public:
 
 };
 
+// Number of records a file Connector hands to Service::OnMessageBatch at once
+const size_t CONNECTOR_BATCH_SIZE = 256;
+
+/**
+ * Bounded lock-free ring for one producer thread and one consumer thread.
+ * The capacity is rounded up to a power of two. Each side keeps a copy of the
+ * other side's index and only reloads it when the ring looks full or empty.
+ */
+template<typename T>
+class SPSCRing
+{
+
+public:
+
+  SPSCRing(size_t capacity);
+
+  // Add an item from the producer thread. False if the ring is full.
+  bool TryPush(const T &item);
+
+  // Take an item from the consumer thread. False if the ring is empty.
+  bool TryPop(T &item);
+
+  bool Empty() const;
+
+private:
+  SPSCRing(const SPSCRing&);
+  SPSCRing& operator=(const SPSCRing&);
+
+  vector<T> slots;
+  size_t mask;
+  // the consumer's and the producer's indices sit on their own cache lines
+  // (padding rather than alignas, which plain new does not honor before C++17)
+  char pad0[64];
+  atomic<size_t> head;
+  size_t cachedTail;
+  char pad1[64];
+  atomic<size_t> tail;
+  size_t cachedHead;
+  char pad2[64];
+
+};
+
+/**
+ * Listener running another listener on its own thread.
+ * Events are copied into an SPSCRing and the consumer thread replays them in
+ * order, passing runs of adds on with ProcessAddBatch. A full ring makes the
+ * calling service wait. Register it on a single service, which must call it
+ * from one thread, e.g. to keep HistoricalDataService file writes off the
+ * price path: SS.AddListener(new AsyncListener<PriceStream<Bond>>(HDSPS.GetListener()));
+ */
+template<typename V>
+class AsyncListener : public ServiceListener<V>
+{
+
+public:
+
+  // With a cpu, the consumer thread is pinned to it
+  AsyncListener(ServiceListener<V> *_listener, size_t capacity = 4096, int cpu = -1);
+  ~AsyncListener();
+
+  void ProcessAdd(V &data);
+  void ProcessRemove(V &data);
+  void ProcessUpdate(V &data);
+  void ProcessAddBatch(V *data, size_t n);
+
+  // Wait until the consumer thread has handled every event pushed so far
+  void Flush();
+
+private:
+  AsyncListener(const AsyncListener&);
+  AsyncListener& operator=(const AsyncListener&);
+
+  enum EventType { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+  struct Event
+  {
+    EventType type;
+    V data;
+  };
+
+  void Push(EventType type, V &data);
+  void Run();
+
+  ServiceListener<V> *listener;
+  SPSCRing<Event> ring;
+  long pushed;
+  atomic<long> handled;
+  atomic<bool> stopping;
+  thread consumer;
+
+};
+
+/**
+ * Merge point of events coming from several threads.
+ * Every producer thread calls its own input listener, backed by its own
+ * SPSCRing. One merge thread takes the events ring after ring and replays them
+ * on the registered listeners, which are only ever called from that thread.
+ * Events of a producer keep their order, events of different producers interleave.
+ */
+template<typename V>
+class MergeListener
+{
+
+public:
+
+  MergeListener(size_t producers, size_t capacity = 4096);
+  ~MergeListener();
+
+  // Add a listener fed by the merge thread, before any event is pushed
+  void AddListener(ServiceListener<V> *listener);
+
+  // Get the input listener of a producer
+  ServiceListener<V>* GetInput(size_t producer);
+
+  // Wait until the merge thread has handled every event pushed so far.
+  // Call it once the producers are done pushing.
+  void Flush();
+
+private:
+  MergeListener(const MergeListener&);
+  MergeListener& operator=(const MergeListener&);
+
+  enum EventType { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+  struct Event
+  {
+    EventType type;
+    V data;
+  };
+
+  struct Producer;
+
+  class Input : public ServiceListener<V>
+  {
+
+  public:
+
+    Input(Producer *_producer);
+
+    void ProcessAdd(V &data);
+    void ProcessRemove(V &data);
+    void ProcessUpdate(V &data);
+
+  private:
+    void Push(EventType type, V &data);
+
+    Producer *producer;
+
+  };
+
+  struct Producer
+  {
+    Producer(size_t capacity);
+
+    SPSCRing<Event> ring;
+    atomic<long> pushed;
+    Input input;
+  };
+
+  void Run();
+  void Replay(vector<V> &adds);
+
+  vector<unique_ptr<Producer>> producers;
+  vector<ServiceListener<V>*> listeners;
+  atomic<long> handled;
+  atomic<bool> stopping;
+  thread merger;
+
+};
+
+// Back off while a ring stays full or empty: yield first, then sleep
+inline void SpinWait(int &spins)
+{
+  if (++spins < 64) this_thread::yield();
+  else this_thread::sleep_for(chrono::microseconds(50));
+}
+
+// Pin a thread to a cpu. Elsewhere than on Linux the scheduler decides.
+inline void PinThread(thread &t, int cpu)
+{
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(t.native_handle(), sizeof(cpus), &cpus);
+#endif
+}
+
+
+
+
+/*    implementation     */
+template<typename T>
+SPSCRing<T>::SPSCRing(size_t capacity)
+  :head(0), cachedTail(0), tail(0), cachedHead(0)
+{
+  size_t size = 2;
+  while (size < capacity) size *= 2;
+  slots.resize(size);
+  mask = size - 1;
+}
+
+template<typename T>
+bool SPSCRing<T>::TryPush(const T &item)
+{
+  size_t t = tail.load(memory_order_relaxed);
+  if (t - cachedHead > mask)
+  {
+    cachedHead = head.load(memory_order_acquire);
+    if (t - cachedHead > mask) return false;
+  }
+  slots[t & mask] = item;
+  tail.store(t + 1, memory_order_release);
+  return true;
+}
+
+template<typename T>
+bool SPSCRing<T>::TryPop(T &item)
+{
+  size_t h = head.load(memory_order_relaxed);
+  if (h == cachedTail)
+  {
+    cachedTail = tail.load(memory_order_acquire);
+    if (h == cachedTail) return false;
+  }
+  item = slots[h & mask];
+  head.store(h + 1, memory_order_release);
+  return true;
+}
+
+template<typename T>
+bool SPSCRing<T>::Empty() const
+{
+  return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+}
+
+
+template<typename V>
+AsyncListener<V>::AsyncListener(ServiceListener<V> *_listener, size_t capacity, int cpu)
+  :listener(_listener), ring(capacity), pushed(0), handled(0), stopping(false)
+{
+  consumer = thread(&AsyncListener<V>::Run, this);
+  if (cpu >= 0) PinThread(consumer, cpu);
+}
+
+template<typename V>
+AsyncListener<V>::~AsyncListener()
+{
+  stopping.store(true, memory_order_release);
+  consumer.join();
+}
+
+template<typename V>
+void AsyncListener<V>::ProcessAdd(V &data)
+{
+  Push(ADD_EVENT, data);
+}
+
+template<typename V>
+void AsyncListener<V>::ProcessRemove(V &data)
+{
+  Push(REMOVE_EVENT, data);
+}
+
+template<typename V>
+void AsyncListener<V>::ProcessUpdate(V &data)
+{
+  Push(UPDATE_EVENT, data);
+}
+
+template<typename V>
+void AsyncListener<V>::ProcessAddBatch(V *data, size_t n)
+{
+  for (size_t i = 0; i < n; i++) Push(ADD_EVENT, data[i]);
+}
+
+template<typename V>
+void AsyncListener<V>::Flush()
+{
+  int spins = 0;
+  while (handled.load(memory_order_acquire) < pushed) SpinWait(spins);
+}
+
+template<typename V>
+void AsyncListener<V>::Push(EventType type, V &data)
+{
+  Event event;
+  event.type = type;
+  event.data = data;
+  int spins = 0;
+  while (!ring.TryPush(event)) SpinWait(spins);
+  pushed++;
+}
+
+template<typename V>
+void AsyncListener<V>::Run()
+{
+  vector<V> adds;
+  adds.reserve(CONNECTOR_BATCH_SIZE);
+  Event event;
+  int spins = 0;
+  while (true)
+  {
+    long count = 0;
+    while (count < (long)CONNECTOR_BATCH_SIZE && ring.TryPop(event))
+    {
+      count++;
+      if (event.type == ADD_EVENT)
+      {
+        adds.push_back(event.data);
+        continue;
+      }
+      // keep the order of events: pass on the adds before a remove or an update
+      if (!adds.empty()) listener->ProcessAddBatch(adds.data(), adds.size());
+      adds.clear();
+      if (event.type == REMOVE_EVENT) listener->ProcessRemove(event.data);
+      else listener->ProcessUpdate(event.data);
+    }
+    if (!adds.empty()) listener->ProcessAddBatch(adds.data(), adds.size());
+    adds.clear();
+
+    if (count > 0)
+    {
+      handled.fetch_add(count, memory_order_release);
+      spins = 0;
+    }
+    else if (stopping.load(memory_order_acquire) && ring.Empty()) break;
+    else SpinWait(spins);
+  }
+}
+
+template<typename V>
+MergeListener<V>::MergeListener(size_t producerCount, size_t capacity)
+  :handled(0), stopping(false)
+{
+  for (size_t i = 0; i < producerCount; i++) producers.push_back(unique_ptr<Producer>(new Producer(capacity)));
+  merger = thread(&MergeListener<V>::Run, this);
+}
+
+template<typename V>
+MergeListener<V>::~MergeListener()
+{
+  stopping.store(true, memory_order_release);
+  merger.join();
+}
+
+template<typename V>
+void MergeListener<V>::AddListener(ServiceListener<V> *listener)
+{
+  listeners.push_back(listener);
+}
+
+template<typename V>
+ServiceListener<V>* MergeListener<V>::GetInput(size_t producer)
+{
+  return &producers[producer]->input;
+}
+
+template<typename V>
+void MergeListener<V>::Flush()
+{
+  long pushed = 0;
+  for (auto &p : producers) pushed += p->pushed.load(memory_order_acquire);
+  int spins = 0;
+  while (handled.load(memory_order_acquire) < pushed) SpinWait(spins);
+}
+
+template<typename V>
+MergeListener<V>::Producer::Producer(size_t capacity)
+  :ring(capacity), pushed(0), input(this) {}
+
+template<typename V>
+MergeListener<V>::Input::Input(Producer *_producer)
+  :producer(_producer) {}
+
+template<typename V>
+void MergeListener<V>::Input::ProcessAdd(V &data)
+{
+  Push(ADD_EVENT, data);
+}
+
+template<typename V>
+void MergeListener<V>::Input::ProcessRemove(V &data)
+{
+  Push(REMOVE_EVENT, data);
+}
+
+template<typename V>
+void MergeListener<V>::Input::ProcessUpdate(V &data)
+{
+  Push(UPDATE_EVENT, data);
+}
+
+template<typename V>
+void MergeListener<V>::Input::Push(EventType type, V &data)
+{
+  Event event;
+  event.type = type;
+  event.data = data;
+  int spins = 0;
+  while (!producer->ring.TryPush(event)) SpinWait(spins);
+  producer->pushed.fetch_add(1, memory_order_release);
+}
+
+template<typename V>
+void MergeListener<V>::Replay(vector<V> &adds)
+{
+  if (adds.empty()) return;
+  for (auto l : listeners) l->ProcessAddBatch(adds.data(), adds.size());
+  adds.clear();
+}
+
+template<typename V>
+void MergeListener<V>::Run()
+{
+  vector<V> adds;
+  adds.reserve(CONNECTOR_BATCH_SIZE);
+  Event event;
+  int spins = 0;
+  while (true)
+  {
+    // at most a batch from each producer in turn, so that none of them starves the others
+    long count = 0;
+    for (auto &p : producers)
+    {
+      long taken = 0;
+      while (taken < (long)CONNECTOR_BATCH_SIZE && p->ring.TryPop(event))
+      {
+        taken++;
+        if (event.type == ADD_EVENT)
+        {
+          adds.push_back(event.data);
+          continue;
+        }
+        Replay(adds);
+        for (auto l : listeners)
+        {
+          if (event.type == REMOVE_EVENT) l->ProcessRemove(event.data);
+          else l->ProcessUpdate(event.data);
+        }
+      }
+      Replay(adds);
+      count += taken;
+    }
+
+    if (count > 0)
+    {
+      handled.fetch_add(count, memory_order_release);
+      spins = 0;
+      continue;
+    }
+    bool empty = true;
+    for (auto &p : producers) empty = empty && p->ring.Empty();
+    if (stopping.load(memory_order_acquire) && empty) break;
+    SpinWait(spins);
+  }
+}
+
 #endif
@@ -0,0 +1,283 @@
+#ifndef STATICPIPELINE_HPP
+#define STATICPIPELINE_HPP
+
+#include <vector>
+#include <type_traits>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.h"
+#include "streamingservice.hpp"
+#include "historicaldataservice.hpp"
+
+using namespace std;
+
+/**
+* A chain of services fixed at compile time.
+* Each stage wraps a service and has Input and Output types and an
+* Output Process(Input&) method; the last stage's Output is void. The pipeline
+* calls the stages directly, so every hop can be inlined where the listener
+* chain makes a virtual ProcessAdd call per service.
+* Batches are passed stage by stage like ProcessAddBatch does.
+*/
+template<typename... Stages>
+class StaticPipeline;
+
+template<typename Last>
+class StaticPipeline<Last>
+{
+
+public:
+
+	typedef typename Last::Input Input;
+
+	StaticPipeline(const Last& _stage);
+
+	// Send one item down the pipeline
+	void Push(Input& data);
+
+	// Send n contiguous items down the pipeline
+	void PushBatch(Input* data, size_t n);
+
+private:
+	Last stage;
+
+};
+
+template<typename First, typename... Rest>
+class StaticPipeline<First, Rest...>
+{
+
+public:
+
+	typedef typename First::Input Input;
+
+	StaticPipeline(const First& _stage, const Rest&... _rest);
+
+	// Send one item down the pipeline
+	void Push(Input& data);
+
+	// Send n contiguous items down the pipeline
+	void PushBatch(Input* data, size_t n);
+
+private:
+	First stage;
+	StaticPipeline<Rest...> rest;
+	// outputs of this stage for the batch being pushed
+	vector<typename decay<typename First::Output>::type> batch;
+
+};
+
+// Build a pipeline from its stages, first stage first
+template<typename... Stages>
+StaticPipeline<Stages...> MakePipeline(const Stages&... stages);
+
+/**
+* Listener feeding a static pipeline, to hang it on a service.
+* This is the only virtual call on the way through the pipeline.
+*/
+template<typename Pipeline>
+class PipelineListener : public ServiceListener<typename Pipeline::Input>
+{
+
+public:
+
+	typedef typename Pipeline::Input V;
+
+	PipelineListener(Pipeline* _pipeline);
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& data);
+
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(V* data, size_t n);
+
+private:
+	Pipeline* pipeline;
+
+};
+
+/**
+* Stage of the AlgoStreamingService: builds and stores the two-way stream of a price.
+*/
+template<typename T>
+class AlgoStreamingStage
+{
+
+public:
+
+	typedef Price<T> Input;
+	typedef AlgoStream<T> Output;
+
+	AlgoStreamingStage(AlgoStreamingService<T>* _service);
+
+	AlgoStream<T> Process(Price<T>& price);
+
+private:
+	AlgoStreamingService<T>* service;
+
+};
+
+/**
+* Stage of the StreamingService: stores the price stream of an algo stream.
+*/
+template<typename T>
+class StreamingStage
+{
+
+public:
+
+	typedef AlgoStream<T> Input;
+	typedef PriceStream<T>& Output;
+
+	StreamingStage(StreamingService<T>* _service);
+
+	PriceStream<T>& Process(AlgoStream<T>& algoStream);
+
+private:
+	StreamingService<T>* service;
+
+};
+
+/**
+* Stage of a HistoricalDataService: persists the data. Ends a pipeline.
+*/
+template<typename V>
+class HistoricalDataStage
+{
+
+public:
+
+	typedef V Input;
+	typedef void Output;
+
+	HistoricalDataStage(HistoricalDataService<V>* _service);
+
+	void Process(V& data);
+
+	void ProcessBatch(V* data, size_t n);
+
+private:
+	HistoricalDataService<V>* service;
+
+};
+
+
+
+
+/*    implementation     */
+template<typename Last>
+StaticPipeline<Last>::StaticPipeline(const Last& _stage)
+	:stage(_stage) {}
+
+template<typename Last>
+void StaticPipeline<Last>::Push(Input& data)
+{
+	stage.Process(data);
+}
+
+template<typename Last>
+void StaticPipeline<Last>::PushBatch(Input* data, size_t n)
+{
+	stage.ProcessBatch(data, n);
+}
+
+template<typename First, typename... Rest>
+StaticPipeline<First, Rest...>::StaticPipeline(const First& _stage, const Rest&... _rest)
+	:stage(_stage), rest(_rest...) {}
+
+template<typename First, typename... Rest>
+void StaticPipeline<First, Rest...>::Push(Input& data)
+{
+	auto&& out = stage.Process(data);
+	rest.Push(out);
+}
+
+template<typename First, typename... Rest>
+void StaticPipeline<First, Rest...>::PushBatch(Input* data, size_t n)
+{
+	batch.clear();
+	for (size_t i = 0; i < n; i++)
+	{
+		batch.push_back(stage.Process(data[i]));
+	}
+	rest.PushBatch(batch.data(), batch.size());
+}
+
+template<typename... Stages>
+StaticPipeline<Stages...> MakePipeline(const Stages&... stages)
+{
+	return StaticPipeline<Stages...>(stages...);
+}
+
+
+template<typename Pipeline>
+PipelineListener<Pipeline>::PipelineListener(Pipeline* _pipeline)
+	:pipeline(_pipeline) {}
+
+template<typename Pipeline>
+void PipelineListener<Pipeline>::ProcessAdd(V& data)
+{
+	pipeline->Push(data);
+}
+
+template<typename Pipeline>
+void PipelineListener<Pipeline>::ProcessRemove(V& data) {}
+
+template<typename Pipeline>
+void PipelineListener<Pipeline>::ProcessUpdate(V& data) {}
+
+template<typename Pipeline>
+void PipelineListener<Pipeline>::ProcessAddBatch(V* data, size_t n)
+{
+	pipeline->PushBatch(data, n);
+}
+
+
+// The services' OnMessage is called qualified so that it is not dispatched virtually
+template<typename T>
+AlgoStreamingStage<T>::AlgoStreamingStage(AlgoStreamingService<T>* _service)
+	:service(_service) {}
+
+template<typename T>
+AlgoStream<T> AlgoStreamingStage<T>::Process(Price<T>& price)
+{
+	AlgoStream<T> algoStream = service->MakeAlgoStream(price);
+	service->AlgoStreamingService<T>::OnMessage(algoStream);
+	return algoStream;
+}
+
+template<typename T>
+StreamingStage<T>::StreamingStage(StreamingService<T>* _service)
+	:service(_service) {}
+
+template<typename T>
+PriceStream<T>& StreamingStage<T>::Process(AlgoStream<T>& algoStream)
+{
+	PriceStream<T>& priceStream = *algoStream.GetPriceStream();
+	service->StreamingService<T>::OnMessage(priceStream);
+	return priceStream;
+}
+
+template<typename V>
+HistoricalDataStage<V>::HistoricalDataStage(HistoricalDataService<V>* _service)
+	:service(_service) {}
+
+template<typename V>
+void HistoricalDataStage<V>::Process(V& data)
+{
+	service->PersistData(data.GetProduct().GetTicker(), data);
+}
+
+template<typename V>
+void HistoricalDataStage<V>::ProcessBatch(V* data, size_t n)
+{
+	service->PersistDataBatch(data, n);
+}
+
+#endif
@@ -10,8 +10,9 @@
 #include "soa.hpp"
 #include "marketdataservice.hpp"
 #include "algostreamingservice.h"
-#include <unordered_map>
 #include "tools.h"
+#include "latency.h"
+#include "metrics.h"
 
 /**
  * A price stream order with price and quantity (visible and hidden)
@@ -23,13 +24,13 @@ public:
 
   // ctor for an order
 	PriceStreamOrder() = default;
-  PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
+  PriceStreamOrder(TickPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
 
   // The side on this order
   PricingSide GetSide() const;
 
   // Get the price on this order
-  double GetPrice() const;
+  TickPrice GetPrice() const;
 
   // Get the visible quantity on this order
   long GetVisibleQuantity() const;
@@ -41,7 +42,7 @@ public:
   string To_string();
 
 private:
-  double price;
+  TickPrice price;
   long visibleQuantity;
   long hiddenQuantity;
   PricingSide side;
@@ -71,12 +72,18 @@ public:
   // Get the offer order
   const PriceStreamOrder& GetOfferOrder() const;
 
+  // Get the TSC stamp of when its price was read, 0 when not traced
+  uint64_t GetIngestTicks() const;
+
+  void SetIngestTicks(uint64_t _ingestTicks);
+
   //get the string to print 
   string To_string();
 private:
-  T product;
+  ProductRef<T> product;
   PriceStreamOrder bidOrder;
   PriceStreamOrder offerOrder;
+  uint64_t ingestTicks = 0;
 
 };
 
@@ -104,6 +111,9 @@ public:
 
 	// Listener callback to process an update event to the Service
 	void ProcessUpdate(AlgoStream<T>& data);
+
+	// Listener callback to process a batch of add events
+	void ProcessAddBatch(AlgoStream<T>* data, size_t n);
 };
 /**
  * Streaming service to publish two-way prices.
@@ -115,12 +125,16 @@ class StreamingService : public Service<string,PriceStream <T> >
 {
 private:
 	ServiceListener<AlgoStream<T>>* listener;
-	unordered_map<string, PriceStream<T>> priceStreams;
+	ProductTable<PriceStream<T>> priceStreams;
 	vector<ServiceListener<PriceStream<T>>*> listeners;
+	// price streams of the batch being published
+	vector<PriceStream<T>> batch;
+	LatencyHistogram* hop;
+	ServiceMetrics metrics;
 public:
 	StreamingService();
 	// Get data on our service given a key
-	PriceStream<T>& GetData(string key);
+	PriceStream<T>& GetData(const string& key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(PriceStream<T>& data);
@@ -136,6 +150,9 @@ public:
     // Publish two-way prices
     void PublishPrice(PriceStream<T>& priceStream);
 
+    // Publish the price streams of a batch of algo streams as one batch
+    void PublishPriceBatch(AlgoStream<T>* algoStreams, size_t n);
+
 };
 
 
@@ -145,7 +162,7 @@ public:
 /*         implementation      */
 
 
-PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
+PriceStreamOrder::PriceStreamOrder(TickPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
 {
   price = _price;
   visibleQuantity = _visibleQuantity;
@@ -153,7 +170,7 @@ PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _h
   side = _side;
 }
 
-double PriceStreamOrder::GetPrice() const
+TickPrice PriceStreamOrder::GetPrice() const
 {
   return price;
 }
@@ -193,7 +210,7 @@ PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder
 template<typename T>
 const T& PriceStream<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
@@ -208,10 +225,28 @@ const PriceStreamOrder& PriceStream<T>::GetOfferOrder() const
   return offerOrder;
 }
 
+template<typename T>
+uint64_t PriceStream<T>::GetIngestTicks() const
+{
+  return ingestTicks;
+}
+
+template<typename T>
+void PriceStream<T>::SetIngestTicks(uint64_t _ingestTicks)
+{
+  ingestTicks = _ingestTicks;
+}
+
+template<typename T>
+uint64_t GetIngestTicks(const PriceStream<T>& data)
+{
+  return data.GetIngestTicks();
+}
+
 template<typename T>
 string PriceStream<T>::To_string() {
-	string ticker = product.GetTicker();
-	return product.GetTicker() + ", " +  bidOrder.To_string() + 
+	string ticker = product->GetTicker();
+	return product->GetTicker() + ", " +  bidOrder.To_string() + 
 		", " + offerOrder.To_string();
 }
 
@@ -230,6 +265,12 @@ void StreamingListener<T>::ProcessAdd(AlgoStream<T>& data)
 	SS->PublishPrice(*_priceStream);
 }
 
+template<typename T>
+void StreamingListener<T>::ProcessAddBatch(AlgoStream<T>* data, size_t n)
+{
+	SS->PublishPriceBatch(data, n);
+}
+
 template<typename T>
 void StreamingListener<T>::ProcessRemove(AlgoStream<T>& data) {}
 
@@ -240,19 +281,22 @@ void StreamingListener<T>::ProcessUpdate(AlgoStream<T>& data) {}
 
 template<typename T>
 StreamingService<T>::StreamingService()
-	:listener(new StreamingListener<T>(this)) {}
+	:listener(new StreamingListener<T>(this)), hop(&LatencyTrace::Hop("StreamingService")), metrics("StreamingService") {}
 
 
 template<typename T>
-PriceStream<T>& StreamingService<T>::GetData(string key)
+PriceStream<T>& StreamingService<T>::GetData(const string& key)
 {
-	return priceStreams[key];
+	return priceStreams[GetProductIndex(key)];
 }
 
 template<typename T>
 void StreamingService<T>::OnMessage(PriceStream<T>& data)
 {
-	priceStreams[data.GetProduct().GetTicker()] = data;
+	priceStreams[data.GetProduct().GetIndex()] = data;
+	hop->RecordSince(data.GetIngestTicks());
+	metrics.In();
+	metrics.SetSize(priceStreams.Size());
 }
 
 template<typename T>
@@ -277,10 +321,31 @@ template<typename T>
 void StreamingService<T>::PublishPrice(PriceStream<T>& priceStream)
 {
 	OnMessage(priceStream);
+	ListenerTimer timer(metrics, listeners.size());
 		for (auto& l : listeners)
 		{
 			l->ProcessAdd(priceStream);
 		}
 }
 
+template<typename T>
+void StreamingService<T>::PublishPriceBatch(AlgoStream<T>* algoStreams, size_t n)
+{
+	batch.clear();
+	for (size_t i = 0; i < n; i++)
+	{
+		batch.push_back(*algoStreams[i].GetPriceStream());
+		OnMessage(batch.back());
+	}
+	ListenerTimer timer(metrics, n * listeners.size());
+	for (auto& l : listeners)
+	{
+		l->ProcessAddBatch(batch.data(), batch.size());
+	}
+}
+
+// copied into the table and batch of StreamingService, and the AsyncListener
+// ring in front of HistoricalDataService
+static_assert(is_trivially_copyable<PriceStream<Bond>>::value, "PriceStream must stay trivially copyable");
+
 #endif
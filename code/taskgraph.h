@@ -0,0 +1,128 @@
+#ifndef TASKGRAPH_HPP
+#define TASKGRAPH_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+* A small DAG executor for the flows of main.cpp.
+* Every task runs on its own thread as soon as the tasks it depends on are
+* done, so independent flows overlap and a run lasts about as long as its
+* longest chain. A task can only depend on tasks added before it, which rules
+* out cycles. Services shared by concurrent tasks must lock themselves.
+*/
+class TaskGraph
+{
+
+public:
+
+	// Add a task running after the given tasks. Returns its id.
+	int AddTask(const string& name, function<void()> fn, const vector<int>& after = vector<int>());
+
+	// Run every task and wait for all of them. Rethrows the first exception of a task;
+	// the tasks depending on a failed task do not run.
+	void Run();
+
+	int GetTaskCount() const;
+
+	// Get the name of a task
+	const string& GetName(int task) const;
+
+	// Get the wall time of a task in the last Run
+	double GetSeconds(int task) const;
+
+	// Get the wall time of the last Run
+	double GetSeconds() const;
+
+private:
+	struct Task
+	{
+		string name;
+		function<void()> fn;
+		vector<int> after;
+		double seconds;
+	};
+
+	vector<Task> tasks;
+	double seconds = 0;
+
+};
+
+
+
+
+/*    implementation     */
+int TaskGraph::AddTask(const string& name, function<void()> fn, const vector<int>& after)
+{
+	int id = tasks.size();
+	for (int a : after)
+	{
+		if (a < 0 || a >= id) throw invalid_argument("task " + name + " depends on an unknown task");
+	}
+	Task task;
+	task.name = name;
+	task.fn = fn;
+	task.after = after;
+	task.seconds = 0;
+	tasks.push_back(task);
+	return id;
+}
+
+void TaskGraph::Run()
+{
+	auto start = chrono::steady_clock::now();
+	vector<shared_future<void>> done(tasks.size());
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		done[i] = async(launch::async, [this, &done, i]() {
+			// get() rethrows the failure of a dependency, which skips this task
+			for (int a : tasks[i].after) done[a].get();
+			auto taskStart = chrono::steady_clock::now();
+			tasks[i].fn();
+			tasks[i].seconds = chrono::duration<double>(chrono::steady_clock::now() - taskStart).count();
+		}).share();
+	}
+
+	exception_ptr failure;
+	for (auto& d : done)
+	{
+		try
+		{
+			d.get();
+		}
+		catch (...)
+		{
+			if (!failure) failure = current_exception();
+		}
+	}
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (failure) rethrow_exception(failure);
+}
+
+int TaskGraph::GetTaskCount() const
+{
+	return tasks.size();
+}
+
+const string& TaskGraph::GetName(int task) const
+{
+	return tasks[task].name;
+}
+
+double TaskGraph::GetSeconds(int task) const
+{
+	return tasks[task].seconds;
+}
+
+double TaskGraph::GetSeconds() const
+{
+	return seconds;
+}
+
+#endif
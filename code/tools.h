@@ -7,8 +7,17 @@
 #include <sstream>
 #include <vector>
 #include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
 
 #pragma warning(disable : 4996)
+
+// Prices are integer counts of 1/256 of a point, the finest Treasury tick,
+// so they add and compare exactly. Text is converted only by PriceSTD/PriceDTS.
+typedef long TickPrice;
+const TickPrice TICKS_PER_POINT = 256;
+
 //get current time in millisecond precision.
 string getCurrentTimestamp()
 {
@@ -16,7 +25,13 @@ string getCurrentTimestamp()
     auto millis = (chrono::duration_cast<chrono::milliseconds> (now.time_since_epoch())).count() % 1000;
     
     std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm tm = *std::localtime(&tt);
+    // localtime shares one buffer between threads
+    std::tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &tt);
+#else
+    localtime_r(&tt, &tm);
+#endif
     std::stringstream ss;
     ss << std::put_time( &tm, "%Y-%m-%d %H:%M:%S") <<':'<<std::setw(3) << std::setfill('0') << millis;
         
@@ -28,9 +43,9 @@ string genID(const int len = 8) {
 		"0123456789"
 		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 		"abcdefghijklmnopqrstuvwxyz";
-	static random_device dev;
-	static mt19937 rng(dev());
-	static uniform_int_distribution<mt19937::result_type> dist6(0, 1000); 
+	// one generator per thread, ids are drawn from several threads with sharded market data
+	thread_local mt19937 rng(random_device{}());
+	uniform_int_distribution<mt19937::result_type> dist6(0, 1000);
 
 
 	string tmp_s;
@@ -44,23 +59,46 @@ string genID(const int len = 8) {
 
 	return tmp_s;
 }
-// Convert fractional price to numerical price.
-double PriceSTD(string stringPrice)
+// Convert fractional price to ticks, e.g. "99-16+" is 99*256 + 16*8 + 4.
+// The digits in [begin, end) are decoded in place, with no allocation and no locale.
+// Throws invalid_argument unless the text is <points>-<32nds 00..31><8ths 0..7 or +>.
+TickPrice PriceSTD(const char* begin, const char* end)
 {
-	int sep = stringPrice.find("-");
-	string Price100 = stringPrice.substr(0,sep);
-	string Price32 = stringPrice.substr(sep+1,2);
-	string Price8 = stringPrice.substr(sep+3,1);
-	if (Price8 == "+") Price8 = "4";
-	return stod(Price100) + stod(Price32) / 32.0 + stod(Price8) / 256.0;
+	const char* p = begin;
+	TickPrice Price100 = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		Price100 = Price100 * 10 + (*p - '0');
+		p++;
+	}
+	if (p == begin || end - p != 4 || p[0] != '-')
+		throw invalid_argument("bad fractional price: " + string(begin, end));
+
+	char d1 = p[1], d2 = p[2], d8 = p[3];
+	if (d1 < '0' || d1 > '3' || d2 < '0' || d2 > '9')
+		throw invalid_argument("bad 32nds in price: " + string(begin, end));
+	int Price32 = (d1 - '0') * 10 + (d2 - '0');
+	if (Price32 > 31)
+		throw invalid_argument("bad 32nds in price: " + string(begin, end));
+
+	int Price8;
+	if (d8 == '+') Price8 = 4;
+	else if (d8 >= '0' && d8 <= '7') Price8 = d8 - '0';
+	else throw invalid_argument("bad 8ths in price: " + string(begin, end));
 
+	return Price100 * TICKS_PER_POINT + Price32 * 8 + Price8;
 }
 
-// Convert numerical price to fractional price.
-string PriceDTS(double doublePrice)
+TickPrice PriceSTD(const string& stringPrice)
 {
-	int Price100 = floor(doublePrice);
-	int Price256 = floor((doublePrice - Price100) * 256);
+	return PriceSTD(stringPrice.data(), stringPrice.data() + stringPrice.size());
+}
+
+// Convert ticks to fractional price.
+string PriceDTS(TickPrice tickPrice)
+{
+	TickPrice Price100 = tickPrice / TICKS_PER_POINT;
+	int Price256 = tickPrice % TICKS_PER_POINT;
 	int Price32 = Price256 / 8;
 	int Price8 = Price256 % 8;
 
@@ -75,42 +113,240 @@ string PriceDTS(double doublePrice)
 
 }
 
-Bond GetBond(string ticker)
+// Convert ticks to a price in points
+double TicksToPoints(TickPrice tickPrice)
+{
+	return tickPrice / double(TICKS_PER_POINT);
+}
+
+// Tickers of the products we trade. The position of a ticker is its product index.
+constexpr int PRODUCT_COUNT = 7;
+constexpr const char* PRODUCT_TICKERS[PRODUCT_COUNT] = { "T2Y", "T3Y", "T5Y", "T7Y", "T10Y", "T20Y", "T30Y" };
+
+// Risk buckets of the curve
+enum Bucket { FRONT_END, BELLY, LONG_END };
+constexpr int BUCKET_COUNT = 3;
+constexpr const char* BUCKET_NAMES[BUCKET_COUNT] = { "FrontEnd", "Belly", "LongEnd" };
+
+/**
+* Reference data of a product we trade. PRODUCT_RECORDS[i] is the product of PRODUCT_TICKERS[i].
+*/
+struct ProductRecord
+{
+	const char* cusip;
+	double coupon;
+	const char* maturityDate;
+	Bucket bucket;
+	double pv01;
+};
+
+constexpr ProductRecord PRODUCT_RECORDS[PRODUCT_COUNT] = {
+	{ "91282CFX4", 0.045, "11/30/2024", FRONT_END, 0.01879 },
+	{ "91282CFW6", 0.045, "11/15/2025", FRONT_END, 0.02761 },
+	{ "91282CFZ9", 0.03875, "11/30/2027", BELLY, 0.04526 },
+	{ "91282CFY2", 0.03875, "11/30/2029", BELLY, 0.06170 },
+	{ "91282CFV8", 0.04125, "11/15/2032", BELLY, 0.08598 },
+	{ "912810TM0", 0.04, "11/15/2042", LONG_END, 0.14420 },
+	{ "912810TL2", 0.04, "11/15/2052", LONG_END, 0.19917 }
+};
+
+// Tickers and CUSIPs are hashed into HASH_SLOTS slots with no two products in
+// the same slot (checked by the static_asserts below), so a lookup is one hash,
+// one table read and one compare.
+constexpr unsigned HASH_SLOTS = 16;
+
+constexpr size_t ConstLength(const char* s)
+{
+	return *s ? 1 + ConstLength(s + 1) : 0;
+}
+
+constexpr unsigned TickerHash(const char* s, size_t len)
+{
+	return len < 2 ? 0 : (2u * (unsigned char)s[1] + len) % HASH_SLOTS;
+}
+
+constexpr unsigned CusipHash(const char* s, size_t len)
+{
+	return len != 9 ? 0 : (unsigned char)s[7] % HASH_SLOTS;
+}
+
+// Get the product in a hash slot, starting the search at product i. -1 if none.
+constexpr int TickerSlot(unsigned slot, int i)
+{
+	return i == PRODUCT_COUNT ? -1 :
+		TickerHash(PRODUCT_TICKERS[i], ConstLength(PRODUCT_TICKERS[i])) == slot ? i : TickerSlot(slot, i + 1);
+}
+
+constexpr int CusipSlot(unsigned slot, int i)
+{
+	return i == PRODUCT_COUNT ? -1 :
+		CusipHash(PRODUCT_RECORDS[i].cusip, ConstLength(PRODUCT_RECORDS[i].cusip)) == slot ? i : CusipSlot(slot, i + 1);
+}
+
+constexpr int TICKER_SLOTS[HASH_SLOTS] = {
+	TickerSlot(0, 0), TickerSlot(1, 0), TickerSlot(2, 0), TickerSlot(3, 0),
+	TickerSlot(4, 0), TickerSlot(5, 0), TickerSlot(6, 0), TickerSlot(7, 0),
+	TickerSlot(8, 0), TickerSlot(9, 0), TickerSlot(10, 0), TickerSlot(11, 0),
+	TickerSlot(12, 0), TickerSlot(13, 0), TickerSlot(14, 0), TickerSlot(15, 0)
+};
+
+constexpr int CUSIP_SLOTS[HASH_SLOTS] = {
+	CusipSlot(0, 0), CusipSlot(1, 0), CusipSlot(2, 0), CusipSlot(3, 0),
+	CusipSlot(4, 0), CusipSlot(5, 0), CusipSlot(6, 0), CusipSlot(7, 0),
+	CusipSlot(8, 0), CusipSlot(9, 0), CusipSlot(10, 0), CusipSlot(11, 0),
+	CusipSlot(12, 0), CusipSlot(13, 0), CusipSlot(14, 0), CusipSlot(15, 0)
+};
+
+// Whether products i and up each own their hash slot
+constexpr bool TickerHashIsPerfect(int i)
+{
+	return i == PRODUCT_COUNT ||
+		(TICKER_SLOTS[TickerHash(PRODUCT_TICKERS[i], ConstLength(PRODUCT_TICKERS[i]))] == i && TickerHashIsPerfect(i + 1));
+}
+
+constexpr bool CusipHashIsPerfect(int i)
+{
+	return i == PRODUCT_COUNT ||
+		(CUSIP_SLOTS[CusipHash(PRODUCT_RECORDS[i].cusip, ConstLength(PRODUCT_RECORDS[i].cusip))] == i && CusipHashIsPerfect(i + 1));
+}
+
+static_assert(TickerHashIsPerfect(0), "two tickers share a hash slot, change TickerHash");
+static_assert(CusipHashIsPerfect(0), "two CUSIPs share a hash slot, change CusipHash");
+
+// Get the product index of a ticker, -1 if we do not trade it
+int GetProductIndex(const char* begin, const char* end)
+{
+	size_t len = end - begin;
+	int i = TICKER_SLOTS[TickerHash(begin, len)];
+	if (i < 0 || strlen(PRODUCT_TICKERS[i]) != len || memcmp(PRODUCT_TICKERS[i], begin, len) != 0) return -1;
+	return i;
+}
+
+int GetProductIndex(const string& ticker)
+{
+	return GetProductIndex(ticker.data(), ticker.data() + ticker.size());
+}
+
+// Get the product index of a CUSIP, -1 if we do not trade it
+int GetCusipIndex(const string& cusip)
+{
+	int i = CUSIP_SLOTS[CusipHash(cusip.data(), cusip.size())];
+	if (i < 0 || cusip != PRODUCT_RECORDS[i].cusip) return -1;
+	return i;
+}
+
+// Get the bond of a product index, built once. An empty bond for -1.
+const Bond& GetBond(int index)
+{
+	static const vector<Bond> bonds = [] {
+		vector<Bond> _bonds(1);
+		for (int i = 0; i < PRODUCT_COUNT; i++)
+		{
+			const ProductRecord& r = PRODUCT_RECORDS[i];
+			_bonds.push_back(Bond(r.cusip, CUSIP, PRODUCT_TICKERS[i], r.coupon, r.maturityDate, i));
+		}
+		return _bonds;
+	}();
+	return bonds[index + 1];
+}
+
+const Bond& GetBond(const string& ticker)
+{
+	return GetBond(GetProductIndex(ticker));
+}
+
+template<>
+const Bond& ProductRegistry<Bond>::Get(int index)
+{
+	if (index < -1 || index >= PRODUCT_COUNT) throw invalid_argument("no bond of index " + to_string(index));
+	return GetBond(index);
+}
+
+// Get the risk bucket of a product index. Belly for products we do not trade.
+Bucket GetBucket(int index)
+{
+	return index < 0 ? BELLY : PRODUCT_RECORDS[index].bucket;
+}
+
+Bucket GetBucket(const string& ticker)
+{
+	return GetBucket(GetProductIndex(ticker));
+}
+
+// Get the PV01 of a product index. 1 for products we do not trade.
+double GetPV01(int index)
 {
-	if (ticker == "T2Y") return Bond("91282CFX4", CUSIP, "T2Y", 0.045, "11/30/2024");
-	if (ticker == "T3Y") return Bond("91282CFW6", CUSIP, "T3Y", 0.045, "11/15/2025");
-	if (ticker == "T5Y") return Bond("91282CFZ9", CUSIP, "T5Y", 0.03875, "11/30/2027");
-	if (ticker == "T7Y") return Bond("91282CFY2", CUSIP, "T7Y", 0.03875, "11/30/2029");
-	if (ticker == "T10Y") return Bond("91282CFV8", CUSIP, "T10Y", 0.04125, "11/15/2032");
-	if (ticker == "T20Y") return Bond("912810TM0", CUSIP, "T20Y", 0.04, "11/15/2042");
-	if (ticker == "T30Y") return Bond("912810TL2", CUSIP, "T30Y", 0.04, "11/15/2052");
-    return Bond();
+	return index < 0 ? 1 : PRODUCT_RECORDS[index].pv01;
 }
 
+double GetPV01(const string& ticker)
+{
+	return GetPV01(GetProductIndex(ticker));
+}
+
+/**
+* Per-product state of a service, in a flat array indexed by product index.
+* Products we do not trade (index -1) share one extra slot, as they shared the
+* empty ticker key of the string keyed maps.
+*/
+template<typename V>
+class ProductTable
+{
+
+public:
+
+	ProductTable();
+
+	// Get the state of a product, marking it as present
+	V& operator[](int index);
+
+	// Get the state of a product, a default V if it has none
+	const V& operator[](int index) const;
+
+	// Whether a product has state
+	bool Contains(int index) const;
+
+	// Get the number of products with state
+	size_t Size() const;
+
+private:
+	vector<V> slots;
+	vector<char> present;
+	size_t size;
 
-vector<string> GetBucket(string ticker) {
-	static vector<string> FrontEnd {"FrontEnd","T2Y","T3Y" };
-	static vector<string> Belly {"Belly","T5Y","T7Y","T10Y" };
-	static vector<string> LongEnd {"LongEnd","T20Y","T30Y" };
-	if (ticker == "T2Y") return FrontEnd;
-	if (ticker == "T3Y") return FrontEnd;
-	if (ticker == "T5Y") return Belly;
-	if (ticker == "T7Y") return Belly;
-	if (ticker == "T10Y") return Belly;
-	if (ticker == "T20Y") return LongEnd;
-	if (ticker == "T30Y") return LongEnd;
-    return Belly;
+};
+
+template<typename V>
+ProductTable<V>::ProductTable()
+	:slots(PRODUCT_COUNT + 1), present(PRODUCT_COUNT + 1, 0), size(0) {}
+
+template<typename V>
+V& ProductTable<V>::operator[](int index)
+{
+	if (!present[index + 1])
+	{
+		present[index + 1] = 1;
+		size++;
+	}
+	return slots[index + 1];
 }
 
-double GetPV01(string ticker) {
-	if (ticker == "T2Y") return 0.01879;
-	if (ticker == "T3Y") return 0.02761;
-	if (ticker == "T5Y") return 0.04526;
-	if (ticker == "T7Y") return 0.06170;
-	if (ticker == "T10Y") return 0.08598;
-	if (ticker == "T20Y") return 0.14420;
-	if (ticker == "T30Y") return 0.19917;
-    return 1;
+template<typename V>
+const V& ProductTable<V>::operator[](int index) const
+{
+	return slots[index + 1];
+}
+
+template<typename V>
+bool ProductTable<V>::Contains(int index) const
+{
+	return present[index + 1] != 0;
+}
+
+template<typename V>
+size_t ProductTable<V>::Size() const
+{
+	return size;
 }
 
 #endif
@@ -10,10 +10,14 @@
 #include <string>
 #include <vector>
 #include "soa.hpp"
+#include "metrics.h"
 #include <fstream>
 #include <unordered_map>
+#include <mutex>
 #include <sstream>
 #include "algoexecutionservice.h"
+#include "csvtokenizer.h"
+#include "followreader.h"
 // Trade sides
 enum Side { BUY, SELL };
 
@@ -29,7 +33,7 @@ public:
 
   // ctor for a trade
 	Trade() = default;
-  Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+  Trade(const T &_product, string _tradeId, TickPrice _price, string _book, long _quantity, Side _side);
 
   // Get the product
   const T& GetProduct() const;
@@ -38,7 +42,7 @@ public:
   const string& GetTradeId() const;
 
   // Get the mid price
-  double GetPrice() const;
+  TickPrice GetPrice() const;
 
   // Get the book
   const string& GetBook() const;
@@ -50,9 +54,9 @@ public:
   Side GetSide() const;
 
 private:
-  T product;
+  ProductRef<T> product;
   string tradeId;
-  double price;
+  TickPrice price;
   string book;
   long quantity;
   Side side;
@@ -101,12 +105,16 @@ private:
 	unordered_map<string, Trade<T>> trades;
 	vector<ServiceListener<Trade<T>>*> listeners;
 	TBListener<T>* listener;
+	// trades are booked one at a time when the trade and execution flows run concurrently;
+	// positions and risk downstream are only reached through here
+	mutex bookingMutex;
+	ServiceMetrics metrics;
 	
 public:
 	TradeBookingService();
 
 	// Get data on our service given a key
-	Trade<T>& GetData(string _key);
+	Trade<T>& GetData(const string& _key);
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Trade<T>& _data);
@@ -133,10 +141,16 @@ class TBSConnector : public Connector<Trade<T>>
 private:
 
 	TradeBookingService<T>* TBS;
+	ReadMode mode;
+	IngestStats stats;
+	ConnectorMetrics metrics;
+
+	// Turn one record of trades.txt into a Trade and book it
+	void ProcessRecord(const FieldRef* blocks, size_t n);
 
 public:
 
-	TBSConnector(TradeBookingService<T>* service);
+	TBSConnector(TradeBookingService<T>* service, ReadMode _mode = STREAM_READ);
 
 	// Publish data to the Connector
 	void Publish(Trade<T>& _data);
@@ -144,6 +158,12 @@ public:
 	// Subscribe data from the Connector
 	void Consume(string file_name);
 
+	// Read records as they are appended to a file or written to a pipe, until the reader ends
+	void Follow(FollowReader& reader);
+
+	// Line count and ingest rate of the last Consume
+	const IngestStats& GetStats() const;
+
 };
 
 
@@ -152,7 +172,7 @@ public:
 
 /*     implementation   */
 template<typename T>
-Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
+Trade<T>::Trade(const T &_product, string _tradeId, TickPrice _price, string _book, long _quantity, Side _side) :
   product(_product)
 {
   tradeId = _tradeId;
@@ -165,7 +185,7 @@ Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book,
 template<typename T>
 const T& Trade<T>::GetProduct() const
 {
-  return product;
+  return product.Get();
 }
 
 template<typename T>
@@ -175,7 +195,7 @@ const string& Trade<T>::GetTradeId() const
 }
 
 template<typename T>
-double Trade<T>::GetPrice() const
+TickPrice Trade<T>::GetPrice() const
 {
   return price;
 }
@@ -247,10 +267,10 @@ void TBListener<T>::ProcessUpdate(ExecutionOrder<T>& _data) {}
 
 template<typename T>
 TradeBookingService<T>::TradeBookingService()
-	:listener(new TBListener<T>(this)) {}
+	:listener(new TBListener<T>(this)), metrics("TradeBookingService") {}
 
 template<typename T>
-Trade<T>& TradeBookingService<T>::GetData(string key)
+Trade<T>& TradeBookingService<T>::GetData(const string& key)
 {
 	return trades[key];
 }
@@ -258,8 +278,12 @@ Trade<T>& TradeBookingService<T>::GetData(string key)
 template<typename T>
 void TradeBookingService<T>::OnMessage(Trade<T>& data)
 {
+	lock_guard<mutex> lock(bookingMutex);
 	trades[data.GetTradeId()] = data;
+	metrics.In();
+	metrics.SetSize(trades.size());
 
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(data);
@@ -290,8 +314,12 @@ TBListener<T>* TradeBookingService<T>::GetListener()
 template<typename T>
 void TradeBookingService<T>::BookTrade(Trade<T>& trade)
 {
+	lock_guard<mutex> lock(bookingMutex);
 	trades[trade.GetTradeId()] = trade;
+	metrics.In();
+	metrics.SetSize(trades.size());
 
+	ListenerTimer timer(metrics, listeners.size());
 	for (auto l : listeners)
 	{
 		l->ProcessAdd(trade);
@@ -303,8 +331,8 @@ void TradeBookingService<T>::BookTrade(Trade<T>& trade)
 
 
 template<typename T>
-TBSConnector<T>::TBSConnector(TradeBookingService<T>* service)
-	:TBS(service) {}
+TBSConnector<T>::TBSConnector(TradeBookingService<T>* service, ReadMode _mode)
+	:TBS(service), mode(_mode), metrics("TBSConnector") {}
 
 template<typename T>
 void TBSConnector<T>::Publish(Trade<T>& _data) {}
@@ -312,26 +340,40 @@ void TBSConnector<T>::Publish(Trade<T>& _data) {}
 template<typename T>
 void TBSConnector<T>::Consume(string file_name)
 {
-	ifstream file(file_name);
-	string line;
-	while (getline(file, line))
-	{
-		stringstream linestream(line); string block;
-		vector<string> blocks;
-		while (getline(linestream, block, ','))
-		{
-            if ((block[block.size()-1] == '\r') || (block[block.size()-1] == '\n')){
-                block.erase(block.size()-1);
-            }
-			blocks.push_back(block);
-		}
-
-		Side side;
-		if (blocks[2] == "Buy") side = BUY;
-		else  side = SELL;
-		Trade<T> _trade(GetBond(blocks[0]), blocks[1], PriceSTD(blocks[3]),
-			blocks[5], stol(blocks[4]), side);
-		TBS->BookTrade(_trade);
-	}
+	stats.Start();
+	long lines = ForEachRecord(file_name, mode, [this](const FieldRef* blocks, size_t n) {
+		ProcessRecord(blocks, n);
+	});
+	stats.Stop(lines);
+}
+
+template<typename T>
+void TBSConnector<T>::Follow(FollowReader& reader)
+{
+	stats.Start();
+	long lines = FollowRecords(reader, [this](const FieldRef* blocks, size_t n) {
+		ProcessRecord(blocks, n);
+	});
+	stats.Stop(lines);
+}
+
+template<typename T>
+void TBSConnector<T>::ProcessRecord(const FieldRef* blocks, size_t n)
+{
+	if (n < 6) return;
+
+	Side side;
+	if (blocks[2] == "Buy") side = BUY;
+	else  side = SELL;
+	Trade<T> _trade(GetBond(GetProductIndex(blocks[0].Begin(), blocks[0].End())), blocks[1].ToString(), PriceSTD(blocks[3].Begin(), blocks[3].End()),
+		blocks[5].ToString(), stol(blocks[4].ToString()), side);
+	metrics.Read();
+	TBS->BookTrade(_trade);
+}
+
+template<typename T>
+const IngestStats& TBSConnector<T>::GetStats() const
+{
+	return stats;
 }
 #endif